@@ -0,0 +1,515 @@
+#ifndef __ELEVATOR_H
+#define __ELEVATOR_H
+
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/sched.h>
+#include <linux/cpumask.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/types.h>
+#include <linux/spinlock.h>
+#include <linux/hashtable.h>
+#include <linux/version.h>
+
+// passenger types
+#define ADULT 1
+#define CHILD 2
+#define ROOM_SERVICE 3
+#define BELLHOP 4
+
+// priority classes, higher value boards first
+#define CLASS_BEST_EFFORT 0
+#define CLASS_SLA 1
+#define CLASS_URGENT 2
+#define NUM_CLASSES 3
+
+// deadline of a best effort passenger, sorts after every real deadline
+#define NO_DEADLINE U64_MAX
+
+// wait time histogram, one bucket per second, last bucket collects everything longer
+#define WAIT_BUCKETS 600
+
+// default elevator capacity, see struct elevator_config
+#define MAX_WEIGHT 30
+#define MAX_UNITS 10
+
+// default time constants in seconds, see struct elevator_config
+#define MOVE_TIME 2
+#define LOAD_TIME 1
+
+#define NUM_TYPES 4
+
+#define START_FLOOR 1
+#define NUM_FLOORS 10
+
+// elevator states
+#define OFFLINE 0
+#define IDLE 1
+#define LOADING 2
+// below are saved in twice in struct
+// when we switch state to loading we want to be able
+// to resume in the same movement directions if there are more
+// passengers going that directions already on a queue
+#define DOWN 3
+#define UP 4
+#define NUM_STATUS 5
+
+// phases of the elevator state machine, see elevator_step()
+#define PHASE_IDLE 0
+#define PHASE_MOVING 1
+#define PHASE_DOORS 2
+#define PHASE_LOADING 3
+#define PHASE_HOLD 4
+#define NUM_PHASES 5
+
+// doors held open for late arrivals are checked this often, see dwell_max_ms
+#define HOLD_SLICE_MS 200
+
+// traffic patterns, see classify_traffic()
+#define TRAFFIC_INTERFLOOR 0
+#define TRAFFIC_UP_PEAK 1
+#define TRAFFIC_DOWN_PEAK 2
+#define NUM_TRAFFIC 3
+
+// elevator_step() result when there is nothing to do until the elevator is kicked
+#define ELEVATOR_PARKED (-1)
+
+// how release_passenger() reports a passenger
+#define RELEASE_DROPPED 0
+#define RELEASE_DELIVERED 1
+#define RELEASE_CANCELLED 2
+
+// waiting passengers indexed by ticket
+#define WAITING_HASH_BITS 10
+
+// call sites of the building mutexes, see struct lock_stats
+#define LOCK_SITE_STEP 0
+#define LOCK_SITE_QUEUE 1
+#define LOCK_SITE_CANCEL 2
+#define LOCK_SITE_STOP 3
+#define LOCK_SITE_REPORT 4
+#define LOCK_SITE_STATS 5
+#define LOCK_SITE_STATE 6
+#define LOCK_SITE_CONFIG 7
+#define LOCK_SITE_TEARDOWN 8
+#define LOCK_SITE_RESET 9
+#define LOCK_SITE_START 10
+#define NUM_LOCK_SITES 11
+
+// smoothed rates over 1, 10 and 60 s, fixed point, see rates_advance()
+#define RATE_WINDOWS 3
+#define RATE_SHIFT 11
+#define RATE_ONE (1 << RATE_SHIFT)
+
+// queue samples kept per floor, see sample_floors()
+#define SAMPLE_RING 128
+
+// building instances
+#define MAX_BUILDINGS 256
+#define BUILDING_NAME_LEN 16
+#define DEFAULT_BUILDING 0
+
+/*
+			elevator type represents the elevator object
+			status: idle, offline, loading, up, down
+			int w_load: weight
+			int unit_load: number of passengers
+			int floor: floor number
+			int direction: UP/DOWN (defined as 4/3)
+			int next_stop: next floor intended to service
+			int shutdown: 1 or 0, if 1 start shutdown procedure, don't accept more passengers
+			int phase: state machine phase, PHASE_IDLE, PHASE_MOVING, PHASE_DOORS or PHASE_LOADING
+			int boarded_per_class: passengers boarded per priority class
+			int deadline_miss: passengers per priority class that boarded after their deadline
+			int wait_hist: boarded passengers by wait time in seconds
+			u64 longest_wait: longest wait in ns seen before boarding
+			int cancelled: waiting passengers cancelled
+			int stops_avoided: cancellations that left nobody to pick up or drop off on their floor
+			u64 hold_start: time the doors started being held on this floor
+			int holds, held_boarded, u64 hold_ns: doors held after loading, passengers that boarded
+				while they were, and the total time they were held
+			int departures, departure_units: stops left with passengers aboard and the units aboard,
+				their ratio over MAX_UNITS is the load factor
+			u64 shutdown_start, last_shutdown_ns: when the last stop was requested and how long
+				it took to deliver everyone aboard and go offline
+			int dropped: waiting passengers dropped when the elevator went offline
+			int drain_plan_floors, drain_plan_ms: route and time predicted at the stop request
+				to drop off everyone aboard, see drain_plan()
+			int drain_floors: floors actually traveled since the stop request
+			u64 status_since, status_ns: when the time of the current status was last accounted,
+				and the time spent in each status up to then, see account_status()
+			int floors_loaded, floors_empty: floors traveled with and without passengers aboard
+			int stops_boarded, stops_unboarded: door cycles where someone got in and where nobody did
+			int departure_weight: weight aboard summed over the departures
+
+*/
+struct elevator {
+	int status;
+	int w_load;
+	int unit_load;
+	int floor;
+	int direction;
+	int next_stop;
+	int shutdown;
+	int phase;
+	int serviced;
+	int up_bound;
+	int low_bound;
+	int served_per_fl[NUM_FLOORS];
+	int boarded_per_class[NUM_CLASSES];
+	int deadline_miss[NUM_CLASSES];
+	int wait_hist[WAIT_BUCKETS];
+	u64 longest_wait;
+	int cancelled;
+	int stops_avoided;
+	u64 hold_start;
+	int holds;
+	int held_boarded;
+	u64 hold_ns;
+	int departures;
+	int departure_units;
+	u64 shutdown_start;
+	u64 last_shutdown_ns;
+	int dropped;
+	int drain_plan_floors;
+	int drain_plan_ms;
+	int drain_floors;
+	u64 status_since;
+	u64 status_ns[NUM_STATUS];
+	int floors_loaded;
+	int floors_empty;
+	int stops_boarded;
+	int stops_unboarded;
+	int departure_weight;
+
+	struct list_head p_list;
+};
+
+/*
+			passenger type [ADULT or CHILD or ROOM_SERVICE or BELLHOP]
+			used to store passenger information after an elevator request
+			weight: 1, 2, 4, 6
+			units: 1,2
+			start: initial floor (1-10)
+			destination: drop off (make sure different then start and between 1-10)
+			prio: priority class, selects the waiting list on the start floor
+			arrival: time of the request in ns
+			deadline: latest time in ns the passenger should board, NO_DEADLINE for best effort
+			boarded: time it got in in ns, 0 while waiting
+			ticket: id of the request, unique within the building
+			producer: file the request came through, 0 for the system calls
+			ring, user_tag: submission ring the request came from and its tag, ring is NULL otherwise
+			tk: tracked ticket to report boarding and delivery to, NULL if nobody waits for it
+
+*/
+typedef struct passenger {
+	int weight;
+	int units;
+	int start;
+	int destination;
+	int type;
+	int prio;
+	u64 arrival;
+	u64 deadline;
+	u64 boarded;
+	u64 ticket;
+	u64 producer;
+	struct elevator_ring *ring;
+	u64 user_tag;
+	struct ticket *tk;
+
+	struct list_head list;
+	struct hlist_node hnode;
+} Passenger;
+
+/*
+			Progress of a request tracked through /dev/elevator, see ELEVATOR_IOC_TICKET_WAIT.
+			Written by the scheduler, read by whoever waits on it.
+			state: ELEVATOR_TICKET_WAITING, BOARDED, DELIVERED or DROPPED
+			wait_ns, ride_ns: time until boarding and time in the car
+			ref: held by the passenger while it exists and by the file that tracks it
+*/
+struct ticket {
+	u64 id;
+	int building;
+	int state;
+	u64 wait_ns;
+	u64 ride_ns;
+	wait_queue_head_t wait;
+	struct hlist_node node;
+	struct kref ref;
+};
+
+/*
+			Timings, capacity and passenger sizes of a building, tunable at runtime through
+			/proc/elevator/control. Never changed in place, a new one replaces it as a whole
+			between two steps, see elevator_set_config().
+			move_ms, load_ms: time to move one floor and to let people out and in
+			max_weight, max_units: capacity of the car
+			weight, units: size of each passenger type, indexed by type - 1
+*/
+struct elevator_config {
+	int move_ms;
+	int load_ms;
+	int max_weight;
+	int max_units;
+	int weight[NUM_TYPES];
+	int units[NUM_TYPES];
+	struct rcu_head rcu;
+};
+
+/*
+			events per second smoothed over each window, fixed point RATE_ONE
+			pending: events counted in the current second
+*/
+struct rate {
+	u32 pending;
+	u32 avg[RATE_WINDOWS];
+};
+
+/*
+			one floor at one sample: passengers waiting and how long the oldest of them waited
+*/
+struct floor_sample {
+	u32 queue;
+	u32 age_ms;
+};
+
+/*
+			queue samples of one floor since the last reset
+*/
+struct queue_stats {
+	u32 min_queue;
+	u32 max_queue;
+	u64 sum_queue;
+	u32 min_age_ms;
+	u32 max_age_ms;
+	u64 sum_age_ms;
+};
+
+/*
+			cost of the state machine transitions leaving one phase
+*/
+struct step_stats {
+	u64 count;
+	u64 total_ns;
+	u64 max_ns;
+};
+
+/*
+			acquisitions of one mutex from one call site, times in ns
+			contended: acquisitions that had to wait, wait_ns only counts those
+*/
+struct lock_site_stats {
+	u64 acquired;
+	u64 contended;
+	u64 wait_ns;
+	u64 wait_max_ns;
+	u64 hold_ns;
+	u64 hold_max_ns;
+};
+
+/*
+			hold and wait times of one mutex, written only with it held, see elevator_lockstat.c
+			held_since, site: when and from where the current holder got it
+*/
+struct lock_stats {
+	u64 held_since;
+	int site;
+	struct lock_site_stats sites[NUM_LOCK_SITES];
+};
+
+/*
+			building type is one independent elevator instance.
+			Every building owns its elevator, waiting lists, locks, worker thread and proc entry,
+			nothing is shared between buildings so they scale across cores.
+			id: index used by the *_id system calls
+			name: /proc/elevator/<name>
+			floors: waiting lists, one per floor and priority class,
+				each list is kept sorted by deadline (FIFO for best effort)
+			floor_count, floor_weight, floor_units: totals of the waiting lists of each floor
+			waiting: every waiting passenger by ticket, protected by floors_l_mutex like floors
+			last_arrival, arrival_gap: time of the last request on each floor and a moving average
+				of the time between requests, protected by floors_l_mutex
+			od_total, od_from_lobby, od_to_lobby: decayed counts of recent requests, all of them,
+				those from START_FLOOR and those to START_FLOOR, fixed point, protected by floors_l_mutex
+			traffic_mode, traffic_switches, since_switch: detected pattern, how often it changed
+				and requests seen since the last change
+			rate_tick, accepted, delivered, floor_accepted, floor_delivered: smoothed rates of
+				requests queued and passengers delivered, per floor by start and destination,
+				rate_tick is the start of the current second, protected by floors_l_mutex
+			sample_ns, sample_next, samples: interval and time of the next queue sample, and
+				samples taken, protected by floors_l_mutex like the samples
+			sample_ring, queue_stats: last SAMPLE_RING samples of every floor and their
+				min/avg/max since the last reset
+			ref: held by the building table and by every system call in flight
+			worker_cpus, worker_policy, worker_prio: placement of the worker threads,
+				worker_prio is the nice value for normal/batch and the rt priority for fifo/rr
+			timer_mode: 0 if elevator_thread runs the state machine,
+				1 if step_work does on the shared elevator workqueue
+			wait, kicked, parked: wake up of a parked elevator, see elevator_kick()
+			hold_wait: the current wait is a door hold that a kick ends early
+			step_due: when the next transition is due, 0 when parked, protected by both mutexes
+			step_stats: cost of the transitions, protected by both mutexes
+			floors_lock_stats, elevator_lock_stats: contention of the two mutexes by call site,
+				take them through floors_lock() and elevator_lock() to be counted
+			events_lock, listeners: readers of the event channel, see post_event()
+			next_ticket: last ticket handed out
+			cfg: active config, replaced with both mutexes held so either one is enough to
+				read it, make_passenger() reads it under rcu_read_lock()
+*/
+struct building {
+	int id;
+	char name[BUILDING_NAME_LEN];
+
+	struct elevator elevator;
+	struct list_head floors[NUM_FLOORS][NUM_CLASSES];
+	int floor_count[NUM_FLOORS];
+	int floor_weight[NUM_FLOORS];
+	int floor_units[NUM_FLOORS];
+	DECLARE_HASHTABLE(waiting, WAITING_HASH_BITS);
+	u64 last_arrival[NUM_FLOORS];
+	u64 arrival_gap[NUM_FLOORS];
+	u32 od_total;
+	u32 od_from_lobby;
+	u32 od_to_lobby;
+	int traffic_mode;
+	int traffic_switches;
+	int since_switch;
+	u64 rate_tick;
+	struct rate accepted;
+	struct rate delivered;
+	struct rate floor_accepted[NUM_FLOORS];
+	struct rate floor_delivered[NUM_FLOORS];
+	u64 sample_ns;
+	u64 sample_next;
+	u64 samples;
+	struct floor_sample sample_ring[NUM_FLOORS][SAMPLE_RING];
+	struct queue_stats queue_stats[NUM_FLOORS];
+
+	struct mutex floors_l_mutex;
+	struct mutex elevator_l_mutex;
+	struct lock_stats floors_lock_stats;
+	struct lock_stats elevator_lock_stats;
+
+	struct task_struct *elevator_thread;
+	struct delayed_work step_work;
+	int timer_mode;
+	wait_queue_head_t wait;
+	atomic_t kicked;
+	atomic_t parked;
+	int hold_wait;
+	u64 step_due;
+	struct step_stats step_stats[NUM_PHASES];
+	struct proc_dir_entry *proc;
+
+	spinlock_t events_lock;
+	struct list_head listeners;
+	atomic64_t next_ticket;
+	struct elevator_config __rcu *cfg;
+
+	cpumask_var_t worker_cpus;
+	int worker_policy;
+	int worker_prio;
+
+	struct kref ref;
+	struct rcu_head rcu;
+};
+
+/*
+			Active config of building @b, called with either of its mutexes held.
+*/
+static inline struct elevator_config *building_cfg(struct building *b){
+	return rcu_dereference_protected(b->cfg, lockdep_is_held(&b->elevator_l_mutex) || lockdep_is_held(&b->floors_l_mutex));
+}
+
+/* elevator_sched.c */
+int init_config(struct building *b);
+long elevator_set_config(struct building *b, const struct elevator_config *cfg);
+void init_floor_lists(struct building *b);
+void free_passengers(struct building *b);
+void release_passenger(Passenger *p, int how);
+void queue_passenger(struct building *b, Passenger *p);
+void unqueue_passenger(struct building *b, Passenger *p);
+long make_passenger(struct building *b, int passenger_type, int start_floor, int destination_floor, Passenger **out);
+void elevator_init(struct building *b);
+long elevator_start(struct building *b);
+long elevator_issue(struct building *b, int passenger_type, int start_floor, int destination_floor);
+void elevator_queue(struct building *b, Passenger *p);
+long elevator_cancel(struct building *b, int by, u64 key, int *avoided);
+void elevator_queue_batch(struct building *b, struct list_head *batch);
+long elevator_stop(struct building *b);
+long elevator_reset_counters(struct building *b);
+void rates_advance(struct building *b, u64 now);
+void clear_samples(struct building *b, u64 now);
+void sample_floors(struct building *b, u64 now);
+u64 floor_oldest(struct building *b, int floor_no);
+int elevator_step(struct building *b);
+void elevator_kick(struct building *b);
+int run_elevator(void *params);
+void elevator_step_work(struct work_struct *work);
+int floor_w_load(struct building *b, int floor_no);
+int floor_u_load(struct building *b, int floor_no);
+int wait_percentile(struct building *b, int pct);
+int load_factor(struct building *b);
+int weight_factor(struct building *b);
+void account_status(struct building *b, u64 now);
+u64 status_time(struct building *b, int status, u64 now);
+int lobby_share(struct building *b, int to);
+extern int aging_dist_weight;
+extern int aging_wait_weight;
+extern int dwell_max_ms;
+extern int traffic_detect;
+extern int sample_ms;
+
+/* elevator_proc.c */
+extern struct workqueue_struct *elevator_wq;
+struct building *building_get(int id);
+void building_put(struct building *b);
+
+/* elevator_ring.c */
+struct elevator_ring;
+void ring_complete(struct elevator_ring *r, u64 user_tag, u32 event, s32 res);
+void ring_put(struct elevator_ring *r);
+int elevator_ring_init(void);
+void elevator_ring_exit(void);
+
+/* elevator_events.c */
+struct elevator_events_params;
+void init_events(struct building *b);
+void post_event(struct building *b, u32 type, int floor, Passenger *p);
+long events_open(struct elevator_events_params __user *arg);
+
+/* elevator_lockstat.c */
+void floors_lock(struct building *b, int site);
+void floors_unlock(struct building *b);
+void elevator_lock(struct building *b, int site);
+int elevator_lock_interruptible(struct building *b, int site);
+void elevator_unlock(struct building *b);
+
+/* elevator_state.c */
+struct elevator_state_xfer;
+long elevator_export(struct building *b, struct elevator_state_xfer *xfer);
+long elevator_import(struct building *b, struct elevator_state_xfer *xfer);
+
+/* elevator_dev.c */
+void ticket_update(struct ticket *tk, int state, u64 wait_ns, u64 ride_ns);
+void ticket_put(struct ticket *tk);
+u64 new_producer_id(void);
+int elevator_dev_init(void);
+void elevator_dev_exit(void);
+
+// compat_ptr_ioctl() is new in 5.5, elevator_dev.c has a copy for older kernels
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0)
+#ifdef CONFIG_COMPAT
+long compat_ptr_ioctl(struct file *file, unsigned int cmd, unsigned long arg);
+#else
+#define compat_ptr_ioctl NULL
+#endif
+#endif
+
+#endif
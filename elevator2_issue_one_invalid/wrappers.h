@@ -3,22 +3,70 @@
 
 #define _GNU_SOURCE
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/syscall.h>
+#include "../elevator_uapi.h"
 
 #define __NR_START_ELEVATOR 333
 #define __NR_ISSUE_REQUEST 334
 #define __NR_STOP_ELEVATOR 335
+#define __NR_START_ELEVATOR_ID 336
+#define __NR_ISSUE_REQUEST_ID 337
+#define __NR_STOP_ELEVATOR_ID 338
+
+/*
+	Requests go through /dev/elevator when the module provides it,
+	otherwise through the system calls of a patched kernel.
+*/
+int elevator_fd() {
+	static int fd = -2;
+
+	if (fd == -2)
+		fd = open("/dev/" ELEVATOR_DEV_NAME, O_RDWR);
+	return fd;
+}
+
+int start_elevator_id(int building) {
+	__u32 id = building;
+
+	if (elevator_fd() < 0)
+		return syscall(__NR_START_ELEVATOR_ID, building);
+	return ioctl(elevator_fd(), ELEVATOR_IOC_START, &id);
+}
+
+int issue_request_id(int building, int type, int start, int dest) {
+	struct elevator_issue issue = { building, 0, { type, start, dest, 0, 0 } };
+
+	if (elevator_fd() < 0)
+		return syscall(__NR_ISSUE_REQUEST_ID, building, type, start, dest);
+	return ioctl(elevator_fd(), ELEVATOR_IOC_ISSUE, &issue);
+}
+
+int stop_elevator_id(int building) {
+	__u32 id = building;
+
+	if (elevator_fd() < 0)
+		return syscall(__NR_STOP_ELEVATOR_ID, building);
+	return ioctl(elevator_fd(), ELEVATOR_IOC_STOP, &id);
+}
 
 int start_elevator() {
-	return syscall(__NR_START_ELEVATOR);
+	if (elevator_fd() < 0)
+		return syscall(__NR_START_ELEVATOR);
+	return start_elevator_id(0);
 }
 
 int issue_request(int type, int start, int dest) {
-	return syscall(__NR_ISSUE_REQUEST, type, start, dest);
+	if (elevator_fd() < 0)
+		return syscall(__NR_ISSUE_REQUEST, type, start, dest);
+	return issue_request_id(0, type, start, dest);
 }
 
 int stop_elevator() {
-	return syscall(__NR_STOP_ELEVATOR);
+	if (elevator_fd() < 0)
+		return syscall(__NR_STOP_ELEVATOR);
+	return stop_elevator_id(0);
 }
 
 #endif
@@ -0,0 +1,65 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../elevator_uapi.h"
+
+/*
+	Print the events of a building as they happen, instead of polling /proc.
+	./events.x [building]
+*/
+
+const char *event_names[] = {"", "ARRIVAL", "DOOR_OPEN", "BOARD", "ALIGHT", "STATE", "CANCEL"};
+const char *status_names[] = {"OFFLINE", "IDLE", "LOADING", "DOWN", "UP"};
+
+int main(int argc, char **argv) {
+	struct elevator_events_params params = { 0, 1024 };
+	struct elevator_event ev[64];
+	struct pollfd pfd;
+	int dev;
+	int fd;
+	int n;
+	int i;
+
+	if (argc > 2) {
+		printf("wrong number of args\n");
+		return -1;
+	}
+	if (argc == 2)
+		params.building = atoi(argv[1]);
+
+	dev = open("/dev/" ELEVATOR_DEV_NAME, O_RDWR);
+	if (dev < 0) {
+		perror("/dev/" ELEVATOR_DEV_NAME);
+		return -1;
+	}
+	fd = ioctl(dev, ELEVATOR_IOC_EVENTS, &params);
+	if (fd < 0) {
+		perror("ELEVATOR_IOC_EVENTS");
+		return -1;
+	}
+	close(dev);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (poll(&pfd, 1, -1) > 0) {
+		n = read(fd, ev, sizeof(ev));
+		if (n < 0)
+			break;
+		for (i = 0; i < n / (int)sizeof(ev[0]); i++) {
+			if (ev[i].lost)
+				printf("... %u events lost\n", ev[i].lost);
+			printf("%llu.%09llu %-9s floor %2d", ev[i].time_ns / 1000000000ULL, ev[i].time_ns % 1000000000ULL,
+				event_names[ev[i].type <= 6 ? ev[i].type : 0], ev[i].floor);
+			if (ev[i].passenger_type)
+				printf(" ticket %llu type %u dest %d", ev[i].ticket, ev[i].passenger_type, ev[i].dest);
+			if (ev[i].duration_ns)
+				printf(" after %llu ms", ev[i].duration_ns / 1000000ULL);
+			printf(" %s\n", ev[i].status <= 4 ? status_names[ev[i].status] : "?");
+		}
+		fflush(stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include "../elevator_uapi.h"
+
+/*
+	Same request mix as elevator4_stress_test, submitted through the
+	shared memory ring of /dev/elevator_ring instead of one system call each.
+*/
+
+#define SQ_ENTRIES 1024
+
+struct ring {
+	int fd;
+	struct elevator_ring_params params;
+	struct elevator_ring_header *hdr;
+	struct elevator_sqe *sqes;
+	struct elevator_cqe *cqes;
+};
+
+long accepted;
+long rejected;
+long delivered;
+long dropped;
+
+int rnd(int min, int max) {
+	return rand() % (max - min + 1) + min; //slight bias towards first k
+}
+
+int rnd_dest(int start) {
+	int chance;
+	int ret;
+	
+	chance = rnd(0, 100);
+	
+	//70%-ish chance of choose 1 as a destination (if not already on floor 1)
+	if (chance <= 70 && start != 1)
+		ret = 1;
+	else {
+		do {
+			ret = rnd(2, 10);
+		} while (ret == start);
+	}
+
+	return ret;
+}
+
+int ring_open(struct ring *r, int building) {
+	void *mem;
+
+	r->fd = open("/dev/" ELEVATOR_RING_NAME, O_RDWR);
+	if (r->fd < 0)
+		return -1;
+	r->params.building = building;
+	r->params.sq_entries = SQ_ENTRIES;
+	r->params.cq_entries = 0;
+	if (ioctl(r->fd, ELEVATOR_RING_SETUP, &r->params) < 0)
+		return -1;
+	mem = mmap(NULL, r->params.mmap_size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+	if (mem == MAP_FAILED)
+		return -1;
+	r->hdr = mem;
+	r->sqes = (struct elevator_sqe *)((char *)mem + r->params.sq_off);
+	r->cqes = (struct elevator_cqe *)((char *)mem + r->params.cq_off);
+	return 0;
+}
+
+void reap(struct ring *r) {
+	unsigned head = r->hdr->cq_head;
+	unsigned tail = __atomic_load_n(&r->hdr->cq_tail, __ATOMIC_ACQUIRE);
+	struct elevator_cqe *cqe;
+
+	for (; head != tail; head++) {
+		cqe = &r->cqes[head & (r->params.cq_entries - 1)];
+		if (cqe->event == ELEVATOR_CQE_ACCEPTED)
+			accepted++;
+		else if (cqe->event == ELEVATOR_CQE_REJECTED)
+			rejected++;
+		else if (cqe->event == ELEVATOR_CQE_DELIVERED)
+			delivered++;
+		else if (cqe->event == ELEVATOR_CQE_DROPPED)
+			dropped++;
+	}
+	__atomic_store_n(&r->hdr->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* wait until the module made room in the submission ring */
+void wait_room(struct ring *r) {
+	struct pollfd pfd = { .fd = r->fd, .events = POLLOUT };
+
+	while (r->hdr->sq_tail - __atomic_load_n(&r->hdr->sq_head, __ATOMIC_ACQUIRE) == r->params.sq_entries) {
+		ioctl(r->fd, ELEVATOR_RING_ENTER);
+		poll(&pfd, 1, 100);
+		reap(r);
+	}
+}
+
+int main(int argc, char **argv) {
+	long times = 1000000; 		// 1 million
+	struct timeval t1;
+	struct timeval t2;
+	struct ring r;
+	struct elevator_sqe *sqe;
+	unsigned tail;
+	double secs;
+	long i;
+	int start;
+	
+	if (argc > 2) {
+		printf("wrong number of args\n");
+		return -1;
+	}
+	if (argc == 2)
+		times = atol(argv[1]);
+	if (ring_open(&r, 0) < 0) {
+		perror("/dev/" ELEVATOR_RING_NAME);
+		return -1;
+	}
+	
+	srand(17); //fixed to ensure everyone gets the same set of requests
+	
+	gettimeofday(&t1, NULL);	
+	tail = r.hdr->sq_tail;
+	for (i = 0; i < times; i++) {
+		if (tail - r.hdr->sq_head == r.params.sq_entries) {
+			__atomic_store_n(&r.hdr->sq_tail, tail, __ATOMIC_RELEASE);
+			wait_room(&r);
+		}
+		sqe = &r.sqes[tail & (r.params.sq_entries - 1)];
+		sqe->type = rnd(1, 4);
+		start = rnd(1, 10);
+		sqe->start = start;
+		sqe->dest = rnd_dest(start);
+		sqe->flags = 0;
+		sqe->user_tag = i;
+		tail++;
+		// one doorbell per half ring
+		if ((tail & (r.params.sq_entries / 2 - 1)) == 0) {
+			__atomic_store_n(&r.hdr->sq_tail, tail, __ATOMIC_RELEASE);
+			ioctl(r.fd, ELEVATOR_RING_ENTER);
+			reap(&r);
+		}
+	}
+	__atomic_store_n(&r.hdr->sq_tail, tail, __ATOMIC_RELEASE);
+	ioctl(r.fd, ELEVATOR_RING_ENTER);
+	while (accepted + rejected < times - r.hdr->cq_overflow) {
+		struct pollfd pfd = { .fd = r.fd, .events = POLLIN };
+		poll(&pfd, 1, 100);
+		reap(&r);
+	}
+	gettimeofday(&t2, NULL);
+
+	secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_usec - t1.tv_usec) / 1e6;
+	printf("Submitted %ld requests in %.3f s (%.0f/s)\n", times, secs, times / secs);
+	printf("Accepted %ld Rejected %ld Delivered %ld Dropped %ld Lost completions %u\n",
+		accepted, rejected, delivered, dropped, r.hdr->cq_overflow);
+
+	return 0;
+}
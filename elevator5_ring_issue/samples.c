@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../elevator_uapi.h"
+
+/*
+	Print the queue samples of a building as CSV, one row per sample, oldest first:
+	seconds before the last sample, then queue length and oldest wait in ms of every floor.
+	./samples.x [building]
+*/
+
+int main(int argc, char **argv) {
+	struct elevator_samples *sa;
+	unsigned long long n;
+	unsigned long long i;
+	int dev;
+	int f;
+
+	sa = calloc(1, sizeof(*sa));
+	if (sa == NULL)
+		return -1;
+	if (argc == 2)
+		sa->building = atoi(argv[1]);
+
+	dev = open("/dev/" ELEVATOR_DEV_NAME, O_RDWR);
+	if (dev < 0) {
+		perror("/dev/" ELEVATOR_DEV_NAME);
+		return -1;
+	}
+	if (ioctl(dev, ELEVATOR_IOC_SAMPLES, sa) < 0) {
+		perror("ELEVATOR_IOC_SAMPLES");
+		return -1;
+	}
+	close(dev);
+
+	printf("# %llu samples every %u ms\n", sa->taken, sa->interval_ms);
+	for (f = 0; f < ELEVATOR_NUM_FLOORS; f++)
+		printf("# floor %d queue %u/%u.%03u/%u oldest wait %u/%u.%03u/%u ms\n", f + 1,
+			sa->queue_min[f], sa->queue_avg[f] / 1000, sa->queue_avg[f] % 1000, sa->queue_max[f],
+			sa->age_min_ms[f], sa->age_avg_ms[f] / 1000, sa->age_avg_ms[f] % 1000, sa->age_max_ms[f]);
+
+	printf("t_s");
+	for (f = 0; f < ELEVATOR_NUM_FLOORS; f++)
+		printf(",queue_%d,wait_ms_%d", f + 1, f + 1);
+	printf("\n");
+	n = sa->taken < ELEVATOR_SAMPLES ? sa->taken : ELEVATOR_SAMPLES;
+	for (i = 0; i < n; i++) {
+		printf("-%.3f", (double)(n - 1 - i) * sa->interval_ms / 1000);
+		for (f = 0; f < ELEVATOR_NUM_FLOORS; f++)
+			printf(",%u,%u", sa->series[f][i].queue, sa->series[f][i].age_ms);
+		printf("\n");
+	}
+	free(sa);
+	return 0;
+}
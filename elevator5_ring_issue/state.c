@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include "../elevator_uapi.h"
+
+/*
+	Save the state of a building to a file and load it back, for module upgrades.
+	./state.x export <building> <file> [--detach]
+	./state.x import <building> <file>
+*/
+
+static int export_state(int dev, int building, const char *path, int detach) {
+	struct elevator_state_xfer xfer = { building, detach ? ELEVATOR_EXPORT_DETACH : 0, 0, 0 };
+	struct elevator_state_header *hdr;
+	char *buf = NULL;
+	FILE *f;
+
+	// ask for the size first, grow the buffer if the building filled up in between
+	while (ioctl(dev, ELEVATOR_IOC_EXPORT, &xfer) < 0) {
+		if (errno != ENOSPC) {
+			perror("ELEVATOR_IOC_EXPORT");
+			return -1;
+		}
+		xfer.size += 64 * sizeof(struct elevator_state_passenger);
+		buf = realloc(buf, xfer.size);
+		if (buf == NULL)
+			return -1;
+		xfer.buf = (unsigned long)buf;
+	}
+
+	f = fopen(path, "wb");
+	if (f == NULL || fwrite(buf, 1, xfer.size, f) != xfer.size) {
+		perror(path);
+		return -1;
+	}
+	fclose(f);
+	hdr = (struct elevator_state_header *)buf;
+	printf("building %d: %u waiting, %u aboard, %llu bytes\n", building, hdr->waiting, hdr->aboard, xfer.size);
+	free(buf);
+	return 0;
+}
+
+static int import_state(int dev, int building, const char *path) {
+	struct elevator_state_xfer xfer = { building, 0, 0, 0 };
+	char *buf;
+	long size;
+	FILE *f;
+
+	f = fopen(path, "rb");
+	if (f == NULL || fseek(f, 0, SEEK_END) || (size = ftell(f)) <= 0) {
+		perror(path);
+		return -1;
+	}
+	rewind(f);
+	buf = malloc(size);
+	if (buf == NULL || fread(buf, 1, size, f) != (size_t)size) {
+		perror(path);
+		return -1;
+	}
+	fclose(f);
+
+	xfer.buf = (unsigned long)buf;
+	xfer.size = size;
+	if (ioctl(dev, ELEVATOR_IOC_IMPORT, &xfer) < 0) {
+		perror("ELEVATOR_IOC_IMPORT");
+		return -1;
+	}
+	free(buf);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	int dev;
+	int ret;
+
+	if (argc < 4 || argc > 5 || (strcmp(argv[1], "export") && strcmp(argv[1], "import"))) {
+		printf("usage: %s export|import <building> <file> [--detach]\n", argv[0]);
+		return -1;
+	}
+	dev = open("/dev/" ELEVATOR_DEV_NAME, O_RDWR);
+	if (dev < 0) {
+		perror("/dev/" ELEVATOR_DEV_NAME);
+		return -1;
+	}
+	if (!strcmp(argv[1], "export"))
+		ret = export_state(dev, atoi(argv[2]), argv[3], argc == 5 && !strcmp(argv[4], "--detach"));
+	else
+		ret = import_state(dev, atoi(argv[2]), argv[3]);
+	close(dev);
+	return ret;
+}
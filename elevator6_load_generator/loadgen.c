@@ -0,0 +1,333 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+#include "wrappers.h"
+
+/*
+	Open-loop load generator.
+	Every thread follows its own schedule of arrivals, drawn ahead of time from the
+	arrival model at rate / threads, and issues each request at its scheduled time
+	whether or not the previous call returned. A request sent late is timed from
+	when it should have been sent, so a stalled call shows up as latency of all the
+	requests queued behind it instead of disappearing (coordinated omission).
+
+	./loadgen.x [-t threads] [-r requests/s] [-d seconds] [-m model] [-b building] [-s seed]
+	models:
+		poisson: exponential gaps, uniform floors
+		bursty: poisson switching between bursts at 5x the rate (20% of the time)
+			and silence, same mean rate
+		uppeak: poisson, 90% from the lobby to a random floor
+		downpeak: poisson, 90% from a random floor to the lobby
+*/
+
+#define MODEL_POISSON 0
+#define MODEL_BURSTY 1
+#define MODEL_UPPEAK 2
+#define MODEL_DOWNPEAK 3
+
+// bursts and silences last 200 ms and 800 ms on average
+#define BURST_FACTOR 5
+#define BURST_MEAN_S 0.2
+#define QUIET_MEAN_S 0.8
+
+/*
+	Log-linear histogram of ns, 16 buckets per power of two (about 6% wide).
+*/
+#define HIST_SUB_BITS 4
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (64 * HIST_SUB)
+
+struct hist {
+	uint64_t count[HIST_BUCKETS];
+	uint64_t n;
+	uint64_t max;
+};
+
+struct worker {
+	pthread_t thread;
+	int id;
+	uint64_t seed;
+	uint64_t accepted;
+	uint64_t rejected;
+	uint64_t errors;
+	uint64_t late;		/* sent more than 1 ms after their time */
+	struct hist service;	/* duration of the call */
+	struct hist response;	/* from the scheduled time to the return */
+};
+
+static const char *model_names[] = {"poisson", "bursty", "uppeak", "downpeak"};
+
+static int threads = 4;
+static double rate = 1000;
+static double duration = 10;
+static int model = MODEL_POISSON;
+static int building = 0;
+static uint64_t seed = 1;
+static uint64_t start_ns;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t) {
+	struct timespec ts;
+
+	ts.tv_sec = t / 1000000000ULL;
+	ts.tv_nsec = t % 1000000000ULL;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+		;
+}
+
+/* splitmix64, every thread has its own stream so runs repeat with the same seed */
+static uint64_t next_random(uint64_t *s) {
+	uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// uniform in (0, 1]
+static double uniform(uint64_t *s) {
+	return ((next_random(s) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static int rnd(uint64_t *s, int min, int max) {
+	return min + next_random(s) % (max - min + 1);
+}
+
+static double exponential(uint64_t *s, double mean) {
+	return -log(uniform(s)) * mean;
+}
+
+static int hist_bucket(uint64_t v) {
+	int e;
+
+	if (v < HIST_SUB)
+		return v;
+	e = 63 - __builtin_clzll(v);
+	return (e - HIST_SUB_BITS + 1) * HIST_SUB + ((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+}
+
+// smallest value that falls in bucket @b
+static uint64_t hist_value(int b) {
+	int e;
+
+	if (b < HIST_SUB)
+		return b;
+	e = b / HIST_SUB + HIST_SUB_BITS - 1;
+	return (1ULL << e) | ((uint64_t)(b % HIST_SUB) << (e - HIST_SUB_BITS));
+}
+
+static void hist_add(struct hist *h, uint64_t v) {
+	h->count[hist_bucket(v)]++;
+	h->n++;
+	if (v > h->max)
+		h->max = v;
+}
+
+static void hist_merge(struct hist *to, struct hist *from) {
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		to->count[i] += from->count[i];
+	to->n += from->n;
+	if (from->max > to->max)
+		to->max = from->max;
+}
+
+static uint64_t hist_percentile(struct hist *h, double pct) {
+	uint64_t want = (uint64_t)ceil(h->n * pct / 100.0);
+	uint64_t seen = 0;
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += h->count[i];
+		if (seen >= want && seen > 0)
+			return hist_value(i);
+	}
+	return h->max;
+}
+
+static void hist_print(const char *name, struct hist *h) {
+	printf("%-9s p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %8.1f us\n", name,
+		hist_percentile(h, 50) / 1e3, hist_percentile(h, 90) / 1e3, hist_percentile(h, 99) / 1e3,
+		hist_percentile(h, 99.9) / 1e3, h->max / 1e3);
+}
+
+// a floor other than @not, the module rejects a request to its own start floor
+static int other_floor(uint64_t *s, int not) {
+	int f;
+
+	do {
+		f = rnd(s, 1, 10);
+	} while (f == not);
+	return f;
+}
+
+/*
+	Start and destination of the next request of the model
+*/
+static void pick_floors(uint64_t *s, int *start, int *dest) {
+	*start = rnd(s, 1, 10);
+	*dest = other_floor(s, *start);
+	if (model == MODEL_UPPEAK && rnd(s, 1, 100) <= 90) {
+		*start = 1;
+		*dest = rnd(s, 2, 10);
+	}
+	else if (model == MODEL_DOWNPEAK && rnd(s, 1, 100) <= 90) {
+		*start = rnd(s, 2, 10);
+		*dest = 1;
+	}
+}
+
+static void *run_worker(void *arg) {
+	struct worker *w = arg;
+	uint64_t s = w->seed;
+	double mean_gap = threads / rate;
+	double t = 0;
+	double phase_end = 0;
+	uint64_t due;
+	uint64_t sent;
+	uint64_t done;
+	int start, dest;
+	int ret;
+
+	if (model == MODEL_BURSTY)
+		phase_end = exponential(&s, BURST_MEAN_S);
+	for (;;) {
+		if (model == MODEL_BURSTY) {
+			t += exponential(&s, mean_gap / BURST_FACTOR);
+			// gaps are memoryless, an arrival past the burst moves to the start of the next one
+			while (t >= phase_end) {
+				t = phase_end + exponential(&s, QUIET_MEAN_S);
+				phase_end = t + exponential(&s, BURST_MEAN_S);
+				t += exponential(&s, mean_gap / BURST_FACTOR);
+			}
+		}
+		else {
+			t += exponential(&s, mean_gap);
+		}
+		if (t >= duration)
+			break;
+
+		pick_floors(&s, &start, &dest);
+		due = start_ns + (uint64_t)(t * 1e9);
+		if (now_ns() < due)
+			sleep_until(due);
+
+		sent = now_ns();
+		ret = issue_request_id(building, rnd(&s, 1, 4), start, dest);
+		done = now_ns();
+
+		if (ret == 0)
+			w->accepted++;
+		else if (ret > 0)
+			w->rejected++;
+		else
+			w->errors++;
+		if (sent > due + 1000000)
+			w->late++;
+		hist_add(&w->service, done - sent);
+		hist_add(&w->response, done - due);
+	}
+	return NULL;
+}
+
+static int parse_model(const char *name) {
+	int i;
+
+	for (i = 0; i < (int)(sizeof(model_names) / sizeof(model_names[0])); i++) {
+		if (strcmp(model_names[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+int main(int argc, char **argv) {
+	struct worker *workers;
+	struct hist service;
+	struct hist response;
+	uint64_t accepted = 0, rejected = 0, errors = 0, late = 0;
+	uint64_t min_sent = UINT64_MAX, max_sent = 0, sent;
+	uint64_t elapsed;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "t:r:d:m:b:s:")) != -1) {
+		switch (opt) {
+		case 't': threads = atoi(optarg); break;
+		case 'r': rate = atof(optarg); break;
+		case 'd': duration = atof(optarg); break;
+		case 'm': model = parse_model(optarg); break;
+		case 'b': building = atoi(optarg); break;
+		case 's': seed = strtoull(optarg, NULL, 0); break;
+		default:
+			printf("usage: %s [-t threads] [-r requests/s] [-d seconds] [-m poisson|bursty|uppeak|downpeak] [-b building] [-s seed]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (threads < 1 || rate <= 0 || duration <= 0 || model < 0) {
+		printf("invalid arguments\n");
+		return -1;
+	}
+
+	workers = calloc(threads, sizeof(*workers));
+	if (workers == NULL)
+		return -1;
+	// open the device before the clock starts, and wake up on time rather than 50 us late
+	elevator_fd();
+	prctl(PR_SET_TIMERSLACK, 1);
+
+	printf("%d threads, %.0f requests/s, %s, %.1f s, building %d, seed %llu\n", threads, rate,
+		model_names[model], duration, building, (unsigned long long)seed);
+	start_ns = now_ns() + 10000000;
+	for (i = 0; i < threads; i++) {
+		workers[i].id = i;
+		workers[i].seed = seed * 1000003 + i;
+		if (pthread_create(&workers[i].thread, NULL, run_worker, &workers[i])) {
+			perror("pthread_create");
+			return -1;
+		}
+	}
+
+	memset(&service, 0, sizeof(service));
+	memset(&response, 0, sizeof(response));
+	for (i = 0; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+		accepted += workers[i].accepted;
+		rejected += workers[i].rejected;
+		errors += workers[i].errors;
+		late += workers[i].late;
+		hist_merge(&service, &workers[i].service);
+		hist_merge(&response, &workers[i].response);
+		sent = workers[i].accepted + workers[i].rejected + workers[i].errors;
+		if (sent < min_sent)
+			min_sent = sent;
+		if (sent > max_sent)
+			max_sent = sent;
+	}
+	// the schedule runs for the whole duration even if its last arrival came early
+	elapsed = now_ns() - start_ns;
+	if (elapsed < duration * 1e9)
+		elapsed = duration * 1e9;
+
+	printf("sent %llu in %.2f s (%.0f/s), accepted %llu, rejected %llu, errors %llu\n",
+		(unsigned long long)service.n, elapsed / 1e9, service.n / (elapsed / 1e9),
+		(unsigned long long)accepted, (unsigned long long)rejected, (unsigned long long)errors);
+	printf("late by more than 1 ms: %llu, per thread %llu to %llu requests\n",
+		(unsigned long long)late, (unsigned long long)min_sent, (unsigned long long)max_sent);
+	hist_print("service", &service);
+	hist_print("response", &response);
+	free(workers);
+	return 0;
+}
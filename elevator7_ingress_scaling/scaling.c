@@ -0,0 +1,324 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "../elevator_uapi.h"
+
+/*
+	Ingress scalability benchmark.
+	For 1..N producer threads, each pinned to its own CPU, hammer one building through
+	ELEVATOR_IOC_ISSUE (one request per call) and ELEVATOR_IOC_ISSUE_BATCH (-B requests per
+	call) for a fixed time. The counters of the building are reset before every step, so the
+	lock lines of /proc/elevator/<name> afterwards belong to that step alone.
+
+	./scaling.x [-t max threads] [-d seconds per step] [-B batch size, 0 for single only]
+		[-b building] [-n name] [-c]
+
+	One row per mode and thread count:
+		req/s: requests issued per second by all threads (accepted or rejected)
+		accepted: share of them queued, the rest were turned away (queue full, offline)
+		min/max: requests of the slowest and fastest thread, as a share of the mean
+		jain: Jain's fairness index of the per thread counts, 1.00 is perfectly even
+		queue: acquisitions of floors_l_mutex by the request path, share contended,
+			average and max wait in us
+		step: share of the worker's acquisitions of floors_l_mutex that were contended
+	-c prints the same as CSV so curves of different releases can be compared.
+*/
+
+#define MODE_SINGLE 0
+#define MODE_BATCH 1
+
+// site names as printed in the Lock Report
+#define LOCK_NAME "floors_l_mutex"
+#define SITE_QUEUE "queue"
+#define SITE_STEP "step"
+
+struct producer {
+	pthread_t thread;
+	int cpu;
+	uint64_t seed;
+	uint64_t requests;
+	uint64_t accepted;
+	uint64_t errors;
+};
+
+struct lock_line {
+	unsigned long long acquired;
+	unsigned long long contended;
+	unsigned long long avg_wait;
+	unsigned long long max_wait;
+};
+
+static int building = 0;
+static const char *name = "default";
+static int batch_size = 64;
+static int mode;
+static volatile int running;
+static pthread_barrier_t barrier;
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* xorshift64, the requests only need to spread over the floors */
+static int rnd(uint64_t *s, int min, int max) {
+	*s ^= *s << 13;
+	*s ^= *s >> 7;
+	*s ^= *s << 17;
+	return min + *s % (max - min + 1);
+}
+
+// a floor other than @not, the module rejects a request to its own start floor
+static int other_floor(uint64_t *s, int not) {
+	int f;
+
+	do {
+		f = rnd(s, 1, 10);
+	} while (f == not);
+	return f;
+}
+
+static void fill_request(uint64_t *s, struct elevator_request *req) {
+	req->type = rnd(s, 1, 4);
+	req->start = rnd(s, 1, 10);
+	req->dest = other_floor(s, req->start);
+	req->res = 0;
+	req->ticket = 0;
+}
+
+static void *run_producer(void *arg) {
+	struct producer *p = arg;
+	struct elevator_request *reqs;
+	struct elevator_batch batch;
+	struct elevator_issue issue;
+	uint64_t s = p->seed;
+	cpu_set_t set;
+	long ret;
+	int dev;
+	int i;
+
+	CPU_ZERO(&set);
+	CPU_SET(p->cpu, &set);
+	if (sched_setaffinity(0, sizeof(set), &set))
+		perror("sched_setaffinity");
+
+	// every producer has its own file, as separate processes would
+	dev = open("/dev/" ELEVATOR_DEV_NAME, O_RDWR);
+	reqs = calloc(batch_size > 0 ? batch_size : 1, sizeof(*reqs));
+	memset(&issue, 0, sizeof(issue));
+	issue.building = building;
+	memset(&batch, 0, sizeof(batch));
+	batch.building = building;
+	batch.count = batch_size;
+	batch.requests = (uintptr_t)reqs;
+
+	pthread_barrier_wait(&barrier);
+	while (running) {
+		if (mode == MODE_SINGLE) {
+			fill_request(&s, &issue.req);
+			ret = ioctl(dev, ELEVATOR_IOC_ISSUE, &issue);
+			p->requests++;
+			if (ret == 0)
+				p->accepted++;
+			else if (ret < 0)
+				p->errors++;
+		}
+		else {
+			for (i = 0; i < batch_size; i++)
+				fill_request(&s, &reqs[i]);
+			ret = ioctl(dev, ELEVATOR_IOC_ISSUE_BATCH, &batch);
+			p->requests += batch_size;
+			if (ret >= 0)
+				p->accepted += ret;
+			else
+				p->errors += batch_size;
+		}
+	}
+
+	free(reqs);
+	if (dev >= 0)
+		close(dev);
+	return NULL;
+}
+
+/*
+	Counters of @site of floors_l_mutex from the report of the building, zero if it
+	was not taken there.
+*/
+static void read_lock_line(const char *site, struct lock_line *l) {
+	char path[64];
+	char prefix[64];
+	char line[512];
+	FILE *f;
+
+	memset(l, 0, sizeof(*l));
+	snprintf(path, sizeof(path), "/proc/elevator/%s", name);
+	snprintf(prefix, sizeof(prefix), "%s %s: ", LOCK_NAME, site);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return;
+	while (fgets(line, sizeof(line), f)) {
+		if (strncmp(line, prefix, strlen(prefix)) != 0)
+			continue;
+		sscanf(line + strlen(prefix), "Acquired: %llu Contended: %llu Avg Wait: %llu ns Max Wait: %llu ns",
+			&l->acquired, &l->contended, &l->avg_wait, &l->max_wait);
+		break;
+	}
+	fclose(f);
+}
+
+static double share(unsigned long long part, unsigned long long total) {
+	return total ? 100.0 * part / total : 0;
+}
+
+/*
+	Run @n producers on the first @n CPUs of @cpus for @seconds and print one row.
+*/
+static int run_step(int dev, int n, int *cpus, double seconds, int csv) {
+	struct producer *producers;
+	struct lock_line queue, step;
+	uint64_t total = 0, accepted = 0, errors = 0;
+	uint64_t min = UINT64_MAX, max = 0;
+	double sum_sq = 0, mean, elapsed;
+	uint64_t begin;
+	__u32 id = building;
+	int i;
+
+	producers = calloc(n, sizeof(*producers));
+	if (producers == NULL)
+		return -1;
+	if (ioctl(dev, ELEVATOR_IOC_RESET, &id) < 0) {
+		perror("ELEVATOR_IOC_RESET");
+		free(producers);
+		return -1;
+	}
+
+	pthread_barrier_init(&barrier, NULL, n + 1);
+	running = 1;
+	for (i = 0; i < n; i++) {
+		producers[i].cpu = cpus[i];
+		producers[i].seed = 0x9e3779b97f4a7c15ULL * (i + 1);
+		if (pthread_create(&producers[i].thread, NULL, run_producer, &producers[i])) {
+			perror("pthread_create");
+			return -1;
+		}
+	}
+	pthread_barrier_wait(&barrier);
+	begin = now_ns();
+	usleep(seconds * 1e6);
+	running = 0;
+	for (i = 0; i < n; i++)
+		pthread_join(producers[i].thread, NULL);
+	elapsed = (now_ns() - begin) / 1e9;
+	pthread_barrier_destroy(&barrier);
+
+	for (i = 0; i < n; i++) {
+		total += producers[i].requests;
+		accepted += producers[i].accepted;
+		errors += producers[i].errors;
+		sum_sq += (double)producers[i].requests * producers[i].requests;
+		if (producers[i].requests < min)
+			min = producers[i].requests;
+		if (producers[i].requests > max)
+			max = producers[i].requests;
+	}
+	mean = (double)total / n;
+	read_lock_line(SITE_QUEUE, &queue);
+	read_lock_line(SITE_STEP, &step);
+
+	if (csv)
+		printf("%s,%d,%.0f,%.1f,%llu,%.2f,%.2f,%.3f,%llu,%.1f,%.2f,%.2f,%.1f\n",
+			mode == MODE_SINGLE ? "single" : "batch", n, total / elapsed, share(accepted, total),
+			(unsigned long long)errors, mean ? min / mean : 0, mean ? max / mean : 0,
+			sum_sq ? (double)total * total / (n * sum_sq) : 0,
+			queue.acquired, share(queue.contended, queue.acquired), queue.avg_wait / 1e3,
+			queue.max_wait / 1e3, share(step.contended, step.acquired));
+	else
+		printf("%-6s %3d %11.0f %7.1f%% %5.2f %5.2f %5.3f %11llu %6.1f%% %8.2f %9.2f %6.1f%%%s\n",
+			mode == MODE_SINGLE ? "single" : "batch", n, total / elapsed, share(accepted, total),
+			mean ? min / mean : 0, mean ? max / mean : 0,
+			sum_sq ? (double)total * total / (n * sum_sq) : 0,
+			queue.acquired, share(queue.contended, queue.acquired), queue.avg_wait / 1e3,
+			queue.max_wait / 1e3, share(step.contended, step.acquired),
+			errors ? " (errors)" : "");
+	fflush(stdout);
+	free(producers);
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	cpu_set_t set;
+	int cpus[CPU_SETSIZE];
+	int ncpus = 0;
+	int max_threads = 0;
+	double seconds = 2;
+	int csv = 0;
+	int opt;
+	int dev;
+	int i, n;
+
+	while ((opt = getopt(argc, argv, "t:d:B:b:n:c")) != -1) {
+		switch (opt) {
+		case 't': max_threads = atoi(optarg); break;
+		case 'd': seconds = atof(optarg); break;
+		case 'B': batch_size = atoi(optarg); break;
+		case 'b': building = atoi(optarg); break;
+		case 'n': name = optarg; break;
+		case 'c': csv = 1; break;
+		default:
+			printf("usage: %s [-t max threads] [-d seconds] [-B batch size] [-b building] [-n name] [-c]\n", argv[0]);
+			return -1;
+		}
+	}
+	if (seconds <= 0 || batch_size < 0 || batch_size > ELEVATOR_BATCH_MAX) {
+		printf("invalid arguments\n");
+		return -1;
+	}
+
+	// one producer per CPU this process may run on, never two on the same one
+	if (sched_getaffinity(0, sizeof(set), &set)) {
+		perror("sched_getaffinity");
+		return -1;
+	}
+	for (i = 0; i < CPU_SETSIZE; i++) {
+		if (CPU_ISSET(i, &set))
+			cpus[ncpus++] = i;
+	}
+	if (max_threads <= 0 || max_threads > ncpus)
+		max_threads = ncpus;
+
+	dev = open("/dev/" ELEVATOR_DEV_NAME, O_RDWR);
+	if (dev < 0) {
+		perror("/dev/" ELEVATOR_DEV_NAME);
+		return -1;
+	}
+
+	if (csv)
+		printf("mode,threads,req_per_s,accepted_pct,errors,min_share,max_share,jain,queue_acquired,queue_contended_pct,queue_avg_wait_us,queue_max_wait_us,step_contended_pct\n");
+	else {
+		printf("building %d (%s), 1 to %d threads, %.1f s per step, batches of %d\n",
+			building, name, max_threads, seconds, batch_size);
+		printf("%-6s %3s %11s %8s %5s %5s %5s %11s %7s %8s %9s %7s\n", "mode", "thr", "req/s",
+			"accepted", "min", "max", "jain", "queue acq", "cont", "avg us", "max us", "step");
+	}
+	for (mode = MODE_SINGLE; mode <= MODE_BATCH; mode++) {
+		if (mode == MODE_BATCH && batch_size == 0)
+			break;
+		for (n = 1; n <= max_threads; n++) {
+			if (run_step(dev, n, cpus, seconds, csv))
+				return -1;
+		}
+	}
+	close(dev);
+	return 0;
+}
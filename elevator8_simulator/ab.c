@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "sim.h"
+
+/*
+	A/B comparison of two scheduler variants.
+	A variant is a command that runs scenarios like scenario.x does, usually scenario.x
+	built from one revision of the scheduler (see make base) with or without -o settings.
+	Both run the same seeds of every scenario, so run i of A and run i of B see the same
+	requests and their difference is down to the scheduler alone. Every metric gets the
+	mean of A and B, the mean difference B - A and the p-value of a paired t-test of the
+	differences. A difference with p below ALPHA is marked better or worse for B.
+
+	./ab.x [-n runs] [-s seed] "<command A>" "<command B>" scenario...
+	e.g. ./ab.x -n 30 ./scenario_base.x ./scenario.x scenarios/uppeak.scn
+	     ./ab.x ./scenario.x "./scenario.x -o dwell_max_ms=0" scenarios/interfloor.scn
+	Exits with 1 if B is significantly worse than A on any metric.
+*/
+
+#define ALPHA 0.05
+#define MAX_RUNS 10000
+#define MAX_METRICS 32
+#define CMD_LEN 4096
+#define ROW_LEN 4096
+
+struct runs {
+	int n;
+	double values[MAX_RUNS][MAX_METRICS];
+};
+
+/*
+	Run @cmd on @scenario and read its CSV into @r, columns in sim_metric_table order.
+	Returns 0, or -1 after printing what went wrong.
+*/
+static int run_variant(const char *cmd, const char *scenario, int runs, const char *seed, struct runs *r) {
+	char line[CMD_LEN];
+	char row[ROW_LEN];
+	int column[64];
+	const struct sim_metric *m;
+	char *tok, *save;
+	int columns = 0;
+	int header = 1;
+	int i, c;
+	FILE *f;
+
+	snprintf(line, sizeof(line), "%s -c -n %d%s%s '%s'", cmd, runs, seed ? " -s " : "", seed ? seed : "", scenario);
+	f = popen(line, "r");
+	if (f == NULL) {
+		perror(line);
+		return -1;
+	}
+	r->n = 0;
+	while (fgets(row, sizeof(row), f)) {
+		row[strcspn(row, "\n")] = '\0';
+		if (header) {
+			// scenario,seed,metric...
+			for (tok = strtok_r(row, ",", &save), c = 0; tok != NULL && c < 64; tok = strtok_r(NULL, ",", &save), c++) {
+				m = find_metric(tok);
+				column[c] = m ? (int)(m - sim_metric_table) : -1;
+			}
+			columns = c;
+			header = 0;
+			continue;
+		}
+		if (r->n == MAX_RUNS)
+			break;
+		for (i = 0; i < num_sim_metrics; i++)
+			r->values[r->n][i] = NAN;
+		for (tok = strtok_r(row, ",", &save), c = 0; tok != NULL && c < columns; tok = strtok_r(NULL, ",", &save), c++) {
+			if (column[c] >= 0)
+				r->values[r->n][column[c]] = atof(tok);
+		}
+		r->n++;
+	}
+	if (pclose(f) != 0 || r->n != runs) {
+		printf("%s: %s did not complete %d runs\n", scenario, cmd, runs);
+		return -1;
+	}
+	return 0;
+}
+
+/*
+	Regularized incomplete beta function I_x(a, b), continued fraction (modified Lentz).
+*/
+static double incomplete_beta(double x, double a, double b) {
+	double front, f, c, d, num;
+	int i, m;
+
+	if (x <= 0)
+		return 0;
+	if (x >= 1)
+		return 1;
+	// the fraction converges fast below the mean, use the symmetry above it
+	if (x > (a + 1) / (a + b + 2))
+		return 1 - incomplete_beta(1 - x, b, a);
+
+	front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) + b * log(1 - x)) / a;
+	f = 1;
+	c = 1;
+	d = 0;
+	for (i = 0; i <= 400; i++) {
+		m = i / 2;
+		if (i == 0)
+			num = 1;
+		else if (i % 2 == 0)
+			num = (m * (b - m) * x) / ((a + 2 * m - 1) * (a + 2 * m));
+		else
+			num = -((a + m) * (a + b + m) * x) / ((a + 2 * m) * (a + 2 * m + 1));
+		d = 1 + num * d;
+		if (fabs(d) < 1e-30)
+			d = 1e-30;
+		d = 1 / d;
+		c = 1 + num / c;
+		if (fabs(c) < 1e-30)
+			c = 1e-30;
+		f *= c * d;
+		if (fabs(1 - c * d) < 1e-10)
+			return front * (f - 1);
+	}
+	return front * (f - 1);
+}
+
+/*
+	Two sided p-value of a paired t-test on the @n differences @d.
+*/
+static double paired_p(const double *d, int n, double *mean_out) {
+	double mean = 0, var = 0, t, df;
+	int i;
+
+	for (i = 0; i < n; i++)
+		mean += d[i];
+	mean /= n;
+	*mean_out = mean;
+	for (i = 0; i < n; i++)
+		var += (d[i] - mean) * (d[i] - mean);
+	if (n < 2)
+		return 1;
+	var /= n - 1;
+	if (var == 0)
+		return mean == 0 ? 1 : 0;
+	t = mean / sqrt(var / n);
+	df = n - 1;
+	return incomplete_beta(df / (df + t * t), df / 2, 0.5);
+}
+
+/*
+	Compare A and B on one scenario. Returns the number of metrics where B is worse.
+*/
+static int compare(const char *scenario, struct runs *a, struct runs *b) {
+	const struct sim_metric *m;
+	double *d;
+	double mean_a, mean_b, diff, p;
+	const char *verdict;
+	int worse = 0;
+	int i, k;
+
+	d = malloc(a->n * sizeof(double));
+	if (d == NULL)
+		return 0;
+	printf("%s, %d runs\n", scenario, a->n);
+	printf("\t%-14s %12s %12s %12s %8s %8s\n", "metric", "A", "B", "B - A", "change", "p");
+	for (i = 0; i < num_sim_metrics; i++) {
+		m = &sim_metric_table[i];
+		mean_a = 0;
+		mean_b = 0;
+		for (k = 0; k < a->n; k++) {
+			mean_a += a->values[k][i];
+			mean_b += b->values[k][i];
+			d[k] = b->values[k][i] - a->values[k][i];
+		}
+		mean_a /= a->n;
+		mean_b /= a->n;
+		p = paired_p(d, a->n, &diff);
+		verdict = "";
+		if (p < ALPHA && diff != 0) {
+			if ((diff < 0) == m->lower_better) {
+				verdict = "better";
+			}
+			else {
+				verdict = "worse";
+				worse++;
+			}
+		}
+		printf("\t%-14s %12.3f %12.3f %+12.3f %+7.1f%% %8.4f  %s\n", m->name, mean_a, mean_b, diff,
+			mean_a ? 100 * diff / fabs(mean_a) : 0, p, verdict);
+	}
+	free(d);
+	return worse;
+}
+
+int main(int argc, char **argv) {
+	struct runs *a, *b;
+	const char *seed = NULL;
+	int runs = 20;
+	int worse = 0;
+	int opt;
+	int i;
+
+	while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+		switch (opt) {
+		case 'n': runs = atoi(optarg); break;
+		case 's': seed = optarg; break;
+		default:
+			printf("usage: %s [-n runs] [-s seed] \"<command A>\" \"<command B>\" scenario...\n", argv[0]);
+			return 2;
+		}
+	}
+	if (argc - optind < 3 || runs < 1 || runs > MAX_RUNS) {
+		printf("usage: %s [-n runs] [-s seed] \"<command A>\" \"<command B>\" scenario...\n", argv[0]);
+		return 2;
+	}
+
+	if (num_sim_metrics > MAX_METRICS) {
+		printf("more than %d metrics, raise MAX_METRICS\n", MAX_METRICS);
+		return 2;
+	}
+	a = malloc(sizeof(*a));
+	b = malloc(sizeof(*b));
+	if (a == NULL || b == NULL)
+		return 2;
+	printf("A: %s\nB: %s\n", argv[optind], argv[optind + 1]);
+	for (i = optind + 2; i < argc; i++) {
+		if (run_variant(argv[optind], argv[i], runs, seed, a) || run_variant(argv[optind + 1], argv[i], runs, seed, b))
+			return 2;
+		worse += compare(argv[i], a, b);
+	}
+	free(a);
+	free(b);
+	return worse ? 1 : 0;
+}
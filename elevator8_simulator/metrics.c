@@ -0,0 +1,122 @@
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+#define METRIC(name, count, lower_better) {#name, offsetof(struct sim_result, name), count, lower_better}
+
+const struct sim_metric sim_metric_table[] = {
+	METRIC(issued, 1, 0),
+	METRIC(rejected, 1, 1),
+	METRIC(delivered, 1, 0),
+	METRIC(dropped, 1, 1),
+	METRIC(deadline_miss, 1, 1),
+	METRIC(end, 0, 1),
+	METRIC(throughput, 0, 0),
+	METRIC(wait_mean, 0, 1),
+	METRIC(wait_p50, 0, 1),
+	METRIC(wait_p99, 0, 1),
+	METRIC(wait_max, 0, 1),
+	METRIC(be_wait_p99, 0, 1),
+	METRIC(be_wait_max, 0, 1),
+	METRIC(ride_mean, 0, 1),
+	METRIC(ride_p50, 0, 1),
+	METRIC(ride_p99, 0, 1),
+	METRIC(travel, 1, 1),
+	METRIC(travel_empty, 1, 1),
+	METRIC(lock_acquired, 1, 1),
+};
+const int num_sim_metrics = sizeof(sim_metric_table) / sizeof(sim_metric_table[0]);
+
+const struct sim_metric *find_metric(const char *name) {
+	int i;
+
+	for (i = 0; i < num_sim_metrics; i++) {
+		if (strcmp(sim_metric_table[i].name, name) == 0)
+			return &sim_metric_table[i];
+	}
+	return NULL;
+}
+
+double metric_value(const struct sim_result *r, const struct sim_metric *m) {
+	const char *field = (const char *)r + m->offset;
+
+	if (m->count)
+		return *(const uint64_t *)field;
+	return *(const double *)field;
+}
+
+/*
+	Wait and ride time of every delivered passenger, kept exactly so percentiles
+	do not depend on a bucket size.
+*/
+
+void metrics_init(struct sim_metrics *m) {
+	m->wait = NULL;
+	m->ride = NULL;
+	m->n = 0;
+	m->size = 0;
+}
+
+void metrics_add(struct sim_metrics *m, uint64_t wait_ns, uint64_t ride_ns) {
+	double *wait, *ride;
+
+	if (m->n == m->size) {
+		m->size = m->size ? m->size * 2 : 1024;
+		wait = realloc(m->wait, m->size * sizeof(double));
+		if (wait != NULL)
+			m->wait = wait;
+		ride = realloc(m->ride, m->size * sizeof(double));
+		if (ride != NULL)
+			m->ride = ride;
+		if (wait == NULL || ride == NULL) {
+			m->size /= 2;
+			return;
+		}
+	}
+	m->wait[m->n] = wait_ns / 1e9;
+	m->ride[m->n] = ride_ns / 1e9;
+	m->n++;
+}
+
+static int cmp_double(const void *a, const void *b) {
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+static double mean(double *v, uint64_t n) {
+	double sum = 0;
+	uint64_t i;
+
+	for (i = 0; i < n; i++)
+		sum += v[i];
+	return n ? sum / n : 0;
+}
+
+// nearest rank of sorted @v
+static double percentile(double *v, uint64_t n, int pct) {
+	uint64_t rank;
+
+	if (n == 0)
+		return 0;
+	rank = (n * pct + 99) / 100;
+	return v[rank ? rank - 1 : 0];
+}
+
+/*
+	Fill the wait and ride fields of @r and free @m.
+*/
+void metrics_finish(struct sim_metrics *m, struct sim_result *r) {
+	qsort(m->wait, m->n, sizeof(double), cmp_double);
+	qsort(m->ride, m->n, sizeof(double), cmp_double);
+	r->wait_mean = mean(m->wait, m->n);
+	r->wait_p50 = percentile(m->wait, m->n, 50);
+	r->wait_p99 = percentile(m->wait, m->n, 99);
+	r->wait_max = m->n ? m->wait[m->n - 1] : 0;
+	r->ride_mean = mean(m->ride, m->n);
+	r->ride_p50 = percentile(m->ride, m->n, 50);
+	r->ride_p99 = percentile(m->ride, m->n, 99);
+	free(m->wait);
+	free(m->ride);
+	metrics_init(m);
+}
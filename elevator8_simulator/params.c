@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim.h"
+
+/*
+	Settings of a run by name, the workload and the module parameters and config
+	fields of the same name. Per type settings take four comma separated values.
+*/
+
+static int parse_int(const char *value, int *out) {
+	char *end;
+	long v = strtol(value, &end, 10);
+
+	if (end == value || *end != '\0' || v < 0 || v > 1000000)
+		return -1;
+	*out = v;
+	return 0;
+}
+
+static int parse_types(const char *value, int *out) {
+	char buf[64];
+	char *tok, *save;
+	int t = 0;
+
+	if (strlen(value) >= sizeof(buf))
+		return -1;
+	strcpy(buf, value);
+	for (tok = strtok_r(buf, ",", &save); tok != NULL; tok = strtok_r(NULL, ",", &save)) {
+		if (t == SIM_TYPES || parse_int(tok, &out[t]))
+			return -1;
+		t++;
+	}
+	return t == SIM_TYPES ? 0 : -1;
+}
+
+/*
+	Set @key to @value in @w or @p.
+	Returns 0, or -1 for an unknown key or a bad value.
+*/
+int parse_setting(const char *key, const char *value, struct sim_workload *w, struct sim_params *p) {
+	static const struct {
+		const char *name;
+		size_t offset;
+		int types;
+	} fields[] = {
+		{"aging_dist_weight", offsetof(struct sim_params, aging_dist_weight), 0},
+		{"aging_wait_weight", offsetof(struct sim_params, aging_wait_weight), 0},
+		{"dwell_max_ms", offsetof(struct sim_params, dwell_max_ms), 0},
+		{"traffic_detect", offsetof(struct sim_params, traffic_detect), 0},
+		{"prio_class", offsetof(struct sim_params, prio_class), 1},
+		{"max_wait", offsetof(struct sim_params, max_wait), 1},
+		{"move_ms", offsetof(struct sim_params, move_ms), 0},
+		{"load_ms", offsetof(struct sim_params, load_ms), 0},
+		{"max_weight", offsetof(struct sim_params, max_weight), 0},
+		{"max_units", offsetof(struct sim_params, max_units), 0},
+		{"weight", offsetof(struct sim_params, weight), 1},
+		{"units", offsetof(struct sim_params, units), 1},
+	};
+	char *end;
+	int i;
+
+	if (strcmp(key, "seed") == 0) {
+		w->seed = strtoull(value, &end, 0);
+		return *end == '\0' ? 0 : -1;
+	}
+	if (strcmp(key, "model") == 0) {
+		w->model = parse_model(value);
+		return w->model < 0 ? -1 : 0;
+	}
+	if (strcmp(key, "rate") == 0) {
+		w->rate = strtod(value, &end);
+		return *end == '\0' && w->rate > 0 ? 0 : -1;
+	}
+	if (strcmp(key, "duration") == 0) {
+		w->duration = strtod(value, &end);
+		return *end == '\0' && w->duration > 0 ? 0 : -1;
+	}
+	if (strcmp(key, "same_floor") == 0) {
+		w->same_floor = strtod(value, &end);
+		return *end == '\0' && w->same_floor >= 0 && w->same_floor <= 1 ? 0 : -1;
+	}
+	if (strcmp(key, "requests") == 0)
+		return parse_int(value, &w->requests);
+
+	for (i = 0; i < (int)(sizeof(fields) / sizeof(fields[0])); i++) {
+		if (strcmp(key, fields[i].name) != 0)
+			continue;
+		if (fields[i].types)
+			return parse_types(value, (int *)((char *)p + fields[i].offset));
+		return parse_int(value, (int *)((char *)p + fields[i].offset));
+	}
+	return -1;
+}
+
+static char *trim(char *s) {
+	char *end;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+		end--;
+	*end = '\0';
+	return s;
+}
+
+/*
+	Read the settings of the scenario file @path into @w and @p, skipping its expect lines.
+	Returns 0, or -1 after printing what is wrong.
+*/
+int load_settings(const char *path, struct sim_workload *w, struct sim_params *p) {
+	char buf[256];
+	char *s, *eq;
+	int line = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(buf, sizeof(buf), f)) {
+		line++;
+		if ((s = strchr(buf, '#')) != NULL)
+			*s = '\0';
+		s = trim(buf);
+		if (*s == '\0' || strncmp(s, "expect ", 7) == 0)
+			continue;
+		eq = strchr(s, '=');
+		if (eq != NULL)
+			*eq = '\0';
+		if (eq == NULL || parse_setting(trim(s), trim(eq + 1), w, p)) {
+			printf("%s:%d: bad setting %s\n", path, line, trim(s));
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
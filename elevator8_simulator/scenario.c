@@ -0,0 +1,376 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include "sim.h"
+
+/*
+	Scenario runner.
+	A scenario file holds the settings of a run, one key=value per line (see params.c),
+	and the golden values of its metrics as
+		expect <metric> <value> <tolerance>
+	where the tolerance is absolute, or relative to the value with a trailing %.
+	The run is simulated in virtual time, so a scenario gives the same numbers on every
+	machine and any metric off by more than its tolerance fails the scenario:
+	REGRESSION if it got worse, IMPROVED if it got better than the golden value says,
+	which has to be confirmed by updating it.
+
+	./scenario.x [-u] [-v] [-s seed] [-n runs] [-c] [-o key=value]... scenario...
+		-u: write the metrics of this run into the files as the new golden values
+		-v: print what the scheduler prints, with the virtual time
+		-s: run with another seed and only print the metrics
+		-n: run seeds seed to seed + runs - 1 and only print the metrics
+		-c: print the metrics as CSV, one row per run, for ab.x
+		-o: change a setting of every scenario, e.g. -o aging_wait_weight=0
+	Exits with 1 if any scenario failed.
+*/
+
+#define MAX_LINES 256
+#define LINE_LEN 256
+#define MAX_OVERRIDES 32
+
+// metrics and tolerances a new scenario gets with -u
+static const struct {
+	const char *name;
+	const char *tolerance;
+} golden_defaults[] = {
+	{"delivered", "0"},
+	{"dropped", "0"},
+	{"deadline_miss", "2"},
+	{"throughput", "2%"},
+	{"wait_mean", "5%"},
+	{"wait_p99", "5%"},
+	{"ride_mean", "5%"},
+	{"ride_p99", "5%"},
+	{"travel", "2%"},
+};
+
+struct expect {
+	const struct sim_metric *metric;
+	double value;
+	double tolerance;
+	int relative;
+	char tolerance_text[32];
+	int line;
+};
+
+struct scenario {
+	char lines[MAX_LINES][LINE_LEN];
+	int num_lines;
+	struct sim_workload workload;
+	struct sim_params params;
+	struct expect expects[MAX_LINES];
+	int num_expects;
+};
+
+static char *trim(char *s) {
+	char *end;
+
+	while (*s == ' ' || *s == '\t')
+		s++;
+	end = s + strlen(s);
+	while (end > s && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r'))
+		end--;
+	*end = '\0';
+	return s;
+}
+
+static int parse_expect(char *s, struct expect *e) {
+	char name[64], tolerance[32];
+	char *end;
+
+	if (sscanf(s, "expect %63s %lf %31s", name, &e->value, tolerance) != 3)
+		return -1;
+	e->metric = find_metric(name);
+	if (e->metric == NULL)
+		return -1;
+	strcpy(e->tolerance_text, tolerance);
+	e->tolerance = strtod(tolerance, &end);
+	e->relative = *end == '%';
+	if (end == tolerance || (*end != '\0' && strcmp(end, "%") != 0) || e->tolerance < 0)
+		return -1;
+	return 0;
+}
+
+/*
+	Read @path into @sc. Returns 0, or -1 after printing what is wrong.
+*/
+static int load_scenario(const char *path, struct scenario *sc) {
+	char buf[LINE_LEN];
+	char *s, *eq;
+	FILE *f;
+
+	memset(sc, 0, sizeof(*sc));
+	sc->workload.seed = 1;
+	sim_params_init(&sc->params);
+	f = fopen(path, "r");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	while (fgets(sc->lines[sc->num_lines], LINE_LEN, f)) {
+		if (sc->num_lines == MAX_LINES - 1) {
+			printf("%s: more than %d lines\n", path, MAX_LINES - 1);
+			fclose(f);
+			return -1;
+		}
+		strcpy(buf, sc->lines[sc->num_lines]);
+		sc->num_lines++;
+		if ((s = strchr(buf, '#')) != NULL)
+			*s = '\0';
+		s = trim(buf);
+		if (*s == '\0')
+			continue;
+		if (strncmp(s, "expect ", 7) == 0) {
+			if (parse_expect(s, &sc->expects[sc->num_expects])) {
+				printf("%s:%d: bad expect line\n", path, sc->num_lines);
+				fclose(f);
+				return -1;
+			}
+			sc->expects[sc->num_expects++].line = sc->num_lines - 1;
+			continue;
+		}
+		eq = strchr(s, '=');
+		if (eq == NULL) {
+			printf("%s:%d: expected key=value\n", path, sc->num_lines);
+			fclose(f);
+			return -1;
+		}
+		*eq = '\0';
+		if (parse_setting(trim(s), trim(eq + 1), &sc->workload, &sc->params)) {
+			printf("%s:%d: bad setting %s\n", path, sc->num_lines, trim(s));
+			fclose(f);
+			return -1;
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static void format_value(char *buf, size_t len, const struct sim_metric *m, double v) {
+	if (m->count)
+		snprintf(buf, len, "%.0f", v);
+	else
+		snprintf(buf, len, "%.3f", v);
+}
+
+/*
+	Compare @r with the golden values of @sc and print every metric.
+	Returns the number of metrics out of tolerance.
+*/
+static int check(struct scenario *sc, struct sim_result *r) {
+	struct expect *e;
+	double actual, allowed;
+	char golden[32], now[32];
+	const char *verdict;
+	int failed = 0;
+	int i;
+
+	for (i = 0; i < sc->num_expects; i++) {
+		e = &sc->expects[i];
+		actual = metric_value(r, e->metric);
+		allowed = e->relative ? fabs(e->value) * e->tolerance / 100 : e->tolerance;
+		verdict = "ok";
+		if (fabs(actual - e->value) > allowed + 1e-9) {
+			verdict = (actual > e->value) == e->metric->lower_better ? "REGRESSION" : "IMPROVED";
+			failed++;
+		}
+		format_value(golden, sizeof(golden), e->metric, e->value);
+		format_value(now, sizeof(now), e->metric, actual);
+		printf("\t%-14s %12s %12s %8.1f%%  %s", e->metric->name, golden, now,
+			e->value ? 100 * (actual - e->value) / fabs(e->value) : 0, verdict);
+		if (strcmp(verdict, "ok") != 0)
+			printf(" (tolerance %s)", e->tolerance_text);
+		printf("\n");
+	}
+	return failed;
+}
+
+static void print_metrics(struct sim_result *r) {
+	char now[32];
+	int i;
+
+	for (i = 0; i < num_sim_metrics; i++) {
+		format_value(now, sizeof(now), &sim_metric_table[i], metric_value(r, &sim_metric_table[i]));
+		printf("\t%-14s %12s\n", sim_metric_table[i].name, now);
+	}
+}
+
+/*
+	Rewrite @path with the metrics of @r as golden values, keeping the tolerances
+	of the metrics it already checks, or adding the default ones.
+*/
+static int update_golden(const char *path, struct scenario *sc, struct sim_result *r) {
+	const struct sim_metric *m;
+	char value[32];
+	FILE *f;
+	int i, j;
+
+	f = fopen(path, "w");
+	if (f == NULL) {
+		perror(path);
+		return -1;
+	}
+	for (i = 0; i < sc->num_lines; i++) {
+		for (j = 0; j < sc->num_expects; j++) {
+			if (sc->expects[j].line == i)
+				break;
+		}
+		if (j == sc->num_expects) {
+			fputs(sc->lines[i], f);
+			continue;
+		}
+		m = sc->expects[j].metric;
+		format_value(value, sizeof(value), m, metric_value(r, m));
+		fprintf(f, "expect %s %s %s\n", m->name, value, sc->expects[j].tolerance_text);
+	}
+	if (sc->num_expects == 0) {
+		for (i = 0; i < (int)(sizeof(golden_defaults) / sizeof(golden_defaults[0])); i++) {
+			m = find_metric(golden_defaults[i].name);
+			format_value(value, sizeof(value), m, metric_value(r, m));
+			fprintf(f, "expect %s %s %s\n", m->name, value, golden_defaults[i].tolerance);
+		}
+	}
+	fclose(f);
+	return 0;
+}
+
+static void print_csv_header(void) {
+	int i;
+
+	printf("scenario,seed");
+	for (i = 0; i < num_sim_metrics; i++)
+		printf(",%s", sim_metric_table[i].name);
+	printf("\n");
+}
+
+static void print_csv(const char *path, unsigned long long seed, struct sim_result *r) {
+	int i;
+
+	printf("%s,%llu", path, seed);
+	for (i = 0; i < num_sim_metrics; i++)
+		printf(",%.6g", metric_value(r, &sim_metric_table[i]));
+	printf("\n");
+}
+
+/*
+	Apply the -o settings to @sc. Returns 0, or -1 after printing the bad one.
+*/
+static int apply_overrides(struct scenario *sc, char **overrides, int n) {
+	char buf[LINE_LEN];
+	char *eq;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		snprintf(buf, sizeof(buf), "%s", overrides[i]);
+		eq = strchr(buf, '=');
+		if (eq != NULL)
+			*eq = '\0';
+		if (eq == NULL || parse_setting(buf, eq + 1, &sc->workload, &sc->params)) {
+			printf("bad setting %s\n", overrides[i]);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+static void usage(const char *name) {
+	printf("usage: %s [-u] [-v] [-s seed] [-n runs] [-c] [-o key=value]... scenario...\n", name);
+}
+
+int main(int argc, char **argv) {
+	struct scenario *sc;
+	struct sim_arrival *arrivals;
+	struct sim_result r;
+	char *overrides[MAX_OVERRIDES];
+	unsigned long long seed = 0;
+	unsigned long long first;
+	int num_overrides = 0;
+	int reseed = 0;
+	int update = 0;
+	int runs = 1;
+	int csv = 0;
+	int failed = 0;
+	int bad;
+	int opt;
+	int n;
+	int i, run;
+
+	while ((opt = getopt(argc, argv, "uvs:n:co:")) != -1) {
+		switch (opt) {
+		case 'u': update = 1; break;
+		case 'v': sim_verbose = 1; break;
+		case 's': seed = strtoull(optarg, NULL, 0); reseed = 1; break;
+		case 'n': runs = atoi(optarg); break;
+		case 'c': csv = 1; break;
+		case 'o':
+			if (num_overrides == MAX_OVERRIDES) {
+				printf("more than %d settings\n", MAX_OVERRIDES);
+				return 2;
+			}
+			overrides[num_overrides++] = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (optind == argc || runs < 1 || (update && (reseed || runs > 1 || csv || num_overrides))) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	sc = malloc(sizeof(*sc));
+	if (sc == NULL)
+		return 2;
+	if (csv)
+		print_csv_header();
+	for (i = optind; i < argc; i++) {
+		if (load_scenario(argv[i], sc) || apply_overrides(sc, overrides, num_overrides)) {
+			failed++;
+			continue;
+		}
+		first = reseed ? seed : sc->workload.seed;
+		for (run = 0; run < runs; run++) {
+			sc->workload.seed = first + run;
+			n = make_workload(&sc->workload, &arrivals);
+			if (n < 0) {
+				printf("%s: invalid workload\n", argv[i]);
+				failed++;
+				break;
+			}
+			if (sim_run(&sc->params, arrivals, n, &r)) {
+				printf("%s: invalid config\n", argv[i]);
+				free(arrivals);
+				failed++;
+				break;
+			}
+			free(arrivals);
+
+			if (csv) {
+				print_csv(argv[i], sc->workload.seed, &r);
+				continue;
+			}
+			printf("%s (%s): %s, seed %llu, %d requests\n", argv[i], sim_backend,
+				model_names[sc->workload.model], (unsigned long long)sc->workload.seed, n);
+			if (update) {
+				if (update_golden(argv[i], sc, &r))
+					failed++;
+				else
+					printf("\tgolden values updated\n");
+				continue;
+			}
+			if (reseed || runs > 1 || num_overrides || sc->num_expects == 0) {
+				print_metrics(&r);
+				continue;
+			}
+			bad = check(sc, &r);
+			printf("%s: %s\n", argv[i], bad ? "FAIL" : "PASS");
+			if (bad)
+				failed++;
+		}
+	}
+	free(sc);
+	return failed ? 1 : 0;
+}
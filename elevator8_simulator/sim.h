@@ -0,0 +1,136 @@
+#ifndef __SIM_H
+#define __SIM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+	Offline simulation of one building in virtual time.
+	workload.c turns a seed and an arrival model into a list of requests, a scheduler
+	backend (sim_current.c) replays them through the scheduler and metrics.c sums up
+	what happened to every passenger. The same seed always gives the same result.
+*/
+
+#define SIM_TYPES 4
+#define SIM_FLOORS 10
+
+// a parameter left at SIM_DEFAULT keeps the value of the scheduler
+#define SIM_DEFAULT (-1)
+
+// arrival models, see workload.c
+#define MODEL_POISSON 0
+#define MODEL_BURSTY 1
+#define MODEL_UPPEAK 2
+#define MODEL_DOWNPEAK 3
+#define MODEL_STRESS 4
+#define NUM_MODELS 5
+
+// passengers still aboard or waiting this long after the last arrival are counted as dropped
+#define SIM_DRAIN_LIMIT_S 3600
+
+struct sim_arrival {
+	uint64_t at_ns;
+	int type;
+	int start;
+	int dest;
+};
+
+struct sim_workload {
+	uint64_t seed;
+	int model;
+	double rate;		/* requests per second */
+	double duration;	/* seconds of arrivals */
+	int requests;		/* stress: number of requests, all at once */
+	double same_floor;	/* share of requests to their own start floor */
+};
+
+/*
+	Policy and config of a run, module parameters and struct elevator_config
+*/
+struct sim_params {
+	int aging_dist_weight;
+	int aging_wait_weight;
+	int dwell_max_ms;
+	int traffic_detect;
+	int prio_class[SIM_TYPES];
+	int max_wait[SIM_TYPES];
+	int move_ms;
+	int load_ms;
+	int max_weight;
+	int max_units;
+	int weight[SIM_TYPES];
+	int units[SIM_TYPES];
+};
+
+/*
+	What a run did. Times in seconds, rates per minute.
+	throughput: delivered per minute of the run, from the first arrival to the last delivery
+	wait: from the request until boarding, ride: from boarding until getting out
+	be_wait: wait of the best effort passengers alone, the ones aging has to keep from starving
+	travel: floors moved, travel_empty: of those with nobody aboard
+	lock_acquired: acquisitions of both building mutexes, nothing contends in a simulation
+*/
+struct sim_result {
+	uint64_t issued;
+	uint64_t rejected;
+	uint64_t delivered;
+	uint64_t dropped;
+	uint64_t deadline_miss;
+	double end;
+	double throughput;
+	double wait_mean;
+	double wait_p50;
+	double wait_p99;
+	double wait_max;
+	double be_wait_p99;
+	double be_wait_max;
+	double ride_mean;
+	double ride_p50;
+	double ride_p99;
+	uint64_t travel;
+	uint64_t travel_empty;
+	uint64_t lock_acquired;
+};
+
+/* workload.c */
+extern const char *model_names[NUM_MODELS];
+int parse_model(const char *name);
+int make_workload(const struct sim_workload *w, struct sim_arrival **out);
+
+/* params.c */
+int parse_setting(const char *key, const char *value, struct sim_workload *w, struct sim_params *p);
+int load_settings(const char *path, struct sim_workload *w, struct sim_params *p);
+
+/* metrics.c */
+struct sim_metrics {
+	double *wait;
+	double *ride;
+	uint64_t n;
+	uint64_t size;
+};
+void metrics_init(struct sim_metrics *m);
+void metrics_add(struct sim_metrics *m, uint64_t wait_ns, uint64_t ride_ns);
+void metrics_finish(struct sim_metrics *m, struct sim_result *r);
+
+/*
+	Fields of struct sim_result by name, count for the integer ones,
+	lower_better for those where less is an improvement
+*/
+struct sim_metric {
+	const char *name;
+	size_t offset;
+	int count;
+	int lower_better;
+};
+extern const struct sim_metric sim_metric_table[];
+extern const int num_sim_metrics;
+const struct sim_metric *find_metric(const char *name);
+double metric_value(const struct sim_result *r, const struct sim_metric *m);
+
+/* backend */
+extern const char *sim_backend;
+extern int sim_verbose;
+void sim_params_init(struct sim_params *p);
+int sim_run(const struct sim_params *p, const struct sim_arrival *a, int n, struct sim_result *r);
+
+#endif
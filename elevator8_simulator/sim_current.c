@@ -0,0 +1,227 @@
+/*
+	Scheduler backend built from the module sources themselves: elevator_sched.c and
+	elevator_lockstat.c are compiled against sim_kernel.h in timer mode, so every
+	transition is elevator_step_work() run at the virtual time its delayed work is due.
+	A request arriving at the same time as a step is queued first, as a request
+	that beats the worker to the floors mutex would be.
+	The sources are found through the include path, the tree above or the revision
+	unpacked by make base.
+*/
+#include "elevator_sched.c"
+#include "elevator_lockstat.c"
+#include "sim.h"
+
+// virtual time starts at 1 s, a boarding time of 0 means still waiting
+#define SIM_EPOCH NSEC_PER_SEC
+#define SIM_NEVER U64_MAX
+
+const char *sim_backend = "current";
+int sim_verbose;
+u64 sim_now;
+struct workqueue_struct *elevator_wq;
+
+/*
+	Every passenger carries the ticket of its class, its updates are the passenger's fate.
+*/
+static struct ticket sim_ticket[NUM_CLASSES];
+static struct sim_metrics *sim_metrics;
+static struct sim_metrics *sim_best_effort;
+static struct sim_result *sim_result;
+static u64 sim_last_delivery;
+
+void ticket_update(struct ticket *tk, int state, u64 wait_ns, u64 ride_ns) {
+	if (state == ELEVATOR_TICKET_DELIVERED) {
+		metrics_add(sim_metrics, wait_ns, ride_ns);
+		if (tk == &sim_ticket[CLASS_BEST_EFFORT])
+			metrics_add(sim_best_effort, wait_ns, ride_ns);
+		sim_result->delivered++;
+		sim_last_delivery = sim_now;
+	}
+	else if (state == ELEVATOR_TICKET_DROPPED) {
+		sim_result->dropped++;
+	}
+}
+
+void ticket_put(struct ticket *tk) {
+}
+
+void post_event(struct building *b, u32 type, int floor, Passenger *p) {
+}
+
+void ring_complete(struct elevator_ring *r, u64 user_tag, u32 event, s32 res) {
+}
+
+void ring_put(struct elevator_ring *r) {
+}
+
+/*
+	Module parameters as loaded, every run starts from them.
+*/
+static struct sim_params defaults;
+static int have_defaults;
+
+static void save_defaults(void) {
+	int t;
+
+	defaults.aging_dist_weight = aging_dist_weight;
+	defaults.aging_wait_weight = aging_wait_weight;
+	defaults.dwell_max_ms = dwell_max_ms;
+	defaults.traffic_detect = traffic_detect;
+	for (t = 0; t < SIM_TYPES; t++) {
+		defaults.prio_class[t] = prio_class[t];
+		defaults.max_wait[t] = max_wait[t];
+	}
+	have_defaults = 1;
+}
+
+static int pick(int value, int fallback) {
+	return value == SIM_DEFAULT ? fallback : value;
+}
+
+void sim_params_init(struct sim_params *p) {
+	memset(p, 0xff, sizeof(*p));
+}
+
+static void apply_params(const struct sim_params *p) {
+	int t;
+
+	if (!have_defaults)
+		save_defaults();
+	aging_dist_weight = pick(p->aging_dist_weight, defaults.aging_dist_weight);
+	aging_wait_weight = pick(p->aging_wait_weight, defaults.aging_wait_weight);
+	dwell_max_ms = pick(p->dwell_max_ms, defaults.dwell_max_ms);
+	traffic_detect = pick(p->traffic_detect, defaults.traffic_detect);
+	for (t = 0; t < SIM_TYPES; t++) {
+		prio_class[t] = pick(p->prio_class[t], defaults.prio_class[t]);
+		max_wait[t] = pick(p->max_wait[t], defaults.max_wait[t]);
+	}
+}
+
+/*
+	A building set up like building_create() does in timer mode, offline through the same
+	elevator_init() and parked, with the config of @p on top of the default one.
+*/
+static struct building *sim_building(const struct sim_params *p) {
+	struct elevator_config cfg;
+	struct building *b;
+	int t;
+
+	b = kzalloc(sizeof(struct building), GFP_KERNEL);
+	if (b == NULL)
+		return NULL;
+	strcpy(b->name, "sim");
+	mutex_init(&b->floors_l_mutex);
+	mutex_init(&b->elevator_l_mutex);
+	init_floor_lists(b);
+	INIT_DELAYED_WORK(&b->step_work, elevator_step_work);
+	b->timer_mode = 1;
+	if (init_config(b)) {
+		kfree(b);
+		return NULL;
+	}
+	elevator_init(b);
+	atomic_set(&b->parked, 1);
+
+	cfg = *building_cfg(b);
+	cfg.move_ms = pick(p->move_ms, cfg.move_ms);
+	cfg.load_ms = pick(p->load_ms, cfg.load_ms);
+	cfg.max_weight = pick(p->max_weight, cfg.max_weight);
+	cfg.max_units = pick(p->max_units, cfg.max_units);
+	for (t = 0; t < SIM_TYPES; t++) {
+		cfg.weight[t] = pick(p->weight[t], cfg.weight[t]);
+		cfg.units[t] = pick(p->units[t], cfg.units[t]);
+	}
+	if (elevator_set_config(b, &cfg)) {
+		kfree(building_cfg(b));
+		kfree(b);
+		return NULL;
+	}
+	return b;
+}
+
+static void count_locks(struct lock_stats *ls, struct sim_result *r) {
+	int i;
+
+	for (i = 0; i < NUM_LOCK_SITES; i++)
+		r->lock_acquired += ls->sites[i].acquired;
+}
+
+/*
+	Replay the @n requests of @a with the policy and config of @p into @r.
+	Runs until everyone is delivered and the elevator parks, or SIM_DRAIN_LIMIT_S after
+	the last request, whoever is left then is dropped.
+	Returns 0, or -1 if @p is not a valid config, out of memory or the new building
+	did not start.
+*/
+int sim_run(const struct sim_params *p, const struct sim_arrival *a, int n, struct sim_result *r) {
+	struct sim_metrics m, best_effort;
+	struct sim_result be;
+	struct building *b;
+	Passenger *passenger;
+	u64 arrival, step, limit;
+	int c;
+	int i = 0;
+
+	memset(r, 0, sizeof(*r));
+	apply_params(p);
+	sim_now = SIM_EPOCH;
+	b = sim_building(p);
+	if (b == NULL)
+		return -1;
+	metrics_init(&m);
+	metrics_init(&best_effort);
+	sim_metrics = &m;
+	sim_best_effort = &best_effort;
+	sim_result = r;
+	sim_last_delivery = sim_now;
+	limit = SIM_EPOCH + (n ? a[n - 1].at_ns : 0) + (u64)SIM_DRAIN_LIMIT_S * NSEC_PER_SEC;
+
+	// a new building has to start, with a 1 the first request would be dropped
+	if (elevator_start(b) != 0) {
+		kfree(building_cfg(b));
+		kfree(b);
+		return -1;
+	}
+	for (;;) {
+		arrival = i < n ? SIM_EPOCH + a[i].at_ns : SIM_NEVER;
+		step = b->step_work.pending ? b->step_work.due : SIM_NEVER;
+		if (arrival == SIM_NEVER && step == SIM_NEVER)
+			break;
+		if (arrival <= step) {
+			sim_now = arrival;
+			r->issued++;
+			if (make_passenger(b, a[i].type, a[i].start, a[i].dest, &passenger) == 0) {
+				passenger->tk = &sim_ticket[passenger->prio];
+				elevator_queue(b, passenger);
+			}
+			else {
+				r->rejected++;
+			}
+			i++;
+			continue;
+		}
+		if (step > limit)
+			break;
+		sim_now = step;
+		b->step_work.pending = 0;
+		elevator_step_work(&b->step_work.work);
+	}
+
+	free_passengers(b);
+	for (c = 0; c < NUM_CLASSES; c++)
+		r->deadline_miss += b->elevator.deadline_miss[c];
+	r->end = (sim_last_delivery - SIM_EPOCH - (n ? a[0].at_ns : 0)) / 1e9;
+	r->throughput = r->end > 0 ? r->delivered * 60 / r->end : 0;
+	r->travel = b->elevator.floors_loaded + b->elevator.floors_empty;
+	r->travel_empty = b->elevator.floors_empty;
+	count_locks(&b->floors_lock_stats, r);
+	count_locks(&b->elevator_lock_stats, r);
+	metrics_finish(&m, r);
+	metrics_finish(&best_effort, &be);
+	r->be_wait_p99 = be.wait_p99;
+	r->be_wait_max = be.wait_max;
+
+	kfree(building_cfg(b));
+	kfree(b);
+	return 0;
+}
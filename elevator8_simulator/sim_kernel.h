@@ -0,0 +1,394 @@
+#ifndef __SIM_KERNEL_H
+#define __SIM_KERNEL_H
+
+/*
+	The part of the kernel API the scheduler uses, for running elevator_sched.c in a
+	single threaded userspace simulation. Time is virtual: ktime_get_ns() returns
+	sim_now, which only the simulation moves. Locks never block, work is queued for
+	the simulation to run at its due time and waits return at once, the caller loops.
+	Every <linux/...> header the scheduler includes is generated to include this file,
+	see the Makefile.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdarg.h>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef unsigned long long u64;
+typedef int32_t s32;
+typedef long long s64;
+typedef u16 __u16;
+typedef u32 __u32;
+typedef u64 __u64;
+typedef s32 __s32;
+typedef s64 __s64;
+typedef unsigned int gfp_t;
+
+#define __user
+#define __rcu
+
+#define U32_MAX ((u32)~0U)
+#define U64_MAX ((u64)~0ULL)
+#define S64_MAX ((s64)(U64_MAX >> 1))
+#define NSEC_PER_SEC 1000000000LL
+#define NSEC_PER_MSEC 1000000L
+#define MSEC_PER_SEC 1000L
+
+#define EINTR 4
+#define ENOMEM 12
+#define EFAULT 14
+#define EBUSY 16
+#define ENODEV 19
+#define EINVAL 22
+#define ENOSPC 28
+#define ERESTARTSYS 512
+
+#define GFP_KERNEL 0
+#define __GFP_RECLAIM 0
+
+// newer than any version check in the module
+#define KERNEL_VERSION(a, b, c) (((a) << 16) + ((b) << 8) + (c))
+#define LINUX_VERSION_CODE KERNEL_VERSION(6, 0, 0)
+
+#define KERN_INFO ""
+#define KERN_NOTICE ""
+#define KERN_WARNING ""
+#define KERN_ERR ""
+
+// printk goes to stderr with the virtual time when sim_verbose is set
+extern int sim_verbose;
+extern u64 sim_now;
+
+static inline int printk(const char *fmt, ...) {
+	va_list ap;
+
+	if (!sim_verbose)
+		return 0;
+	fprintf(stderr, "[%10.3f] ", sim_now / 1e9);
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+	return 0;
+}
+
+#define pr_debug(fmt, ...) printk(fmt, ##__VA_ARGS__)
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define min_t(t, a, b) ((t)(a) < (t)(b) ? (t)(a) : (t)(b))
+#define max_t(t, a, b) ((t)(a) > (t)(b) ? (t)(a) : (t)(b))
+#define clamp(v, lo, hi) min(max(v, lo), hi)
+#define DIV_ROUND_UP(n, d) (((n) + (d) - 1) / (d))
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define BUILD_BUG_ON(c) ((void)sizeof(char[1 - 2 * !!(c)]))
+#define container_of(ptr, type, member) ((type *)((char *)(ptr) - offsetof(type, member)))
+#define READ_ONCE(x) (x)
+#define WRITE_ONCE(x, v) ((x) = (v))
+
+static inline u64 div64_u64(u64 a, u64 b) {
+	return a / b;
+}
+
+static inline u64 div_u64(u64 a, u32 b) {
+	return a / b;
+}
+
+/* lists */
+struct list_head {
+	struct list_head *next, *prev;
+};
+
+struct hlist_node {
+	struct hlist_node *next, **pprev;
+};
+
+struct hlist_head {
+	struct hlist_node *first;
+};
+
+#define LIST_HEAD_INIT(n) { &(n), &(n) }
+#define LIST_HEAD(n) struct list_head n = LIST_HEAD_INIT(n)
+
+static inline void INIT_LIST_HEAD(struct list_head *h) {
+	h->next = h;
+	h->prev = h;
+}
+
+static inline void __list_add(struct list_head *n, struct list_head *prev, struct list_head *next) {
+	next->prev = n;
+	n->next = next;
+	n->prev = prev;
+	prev->next = n;
+}
+
+static inline void list_add(struct list_head *n, struct list_head *head) {
+	__list_add(n, head, head->next);
+}
+
+static inline void list_add_tail(struct list_head *n, struct list_head *head) {
+	__list_add(n, head->prev, head);
+}
+
+static inline void list_del(struct list_head *e) {
+	e->next->prev = e->prev;
+	e->prev->next = e->next;
+	e->next = NULL;
+	e->prev = NULL;
+}
+
+static inline void list_del_init(struct list_head *e) {
+	e->next->prev = e->prev;
+	e->prev->next = e->next;
+	INIT_LIST_HEAD(e);
+}
+
+static inline void list_move_tail(struct list_head *e, struct list_head *head) {
+	e->next->prev = e->prev;
+	e->prev->next = e->next;
+	list_add_tail(e, head);
+}
+
+static inline int list_empty(const struct list_head *h) {
+	return h->next == h;
+}
+
+#define list_entry(ptr, type, member) container_of(ptr, type, member)
+#define list_first_entry(ptr, type, member) list_entry((ptr)->next, type, member)
+#define list_for_each(pos, head) for (pos = (head)->next; pos != (head); pos = pos->next)
+#define list_for_each_prev(pos, head) for (pos = (head)->prev; pos != (head); pos = pos->prev)
+#define list_for_each_safe(pos, n, head) \
+	for (pos = (head)->next, n = pos->next; pos != (head); pos = n, n = pos->next)
+#define list_for_each_prev_safe(pos, n, head) \
+	for (pos = (head)->prev, n = pos->prev; pos != (head); pos = n, n = pos->prev)
+#define list_for_each_entry(pos, head, member) \
+	for (pos = list_entry((head)->next, __typeof__(*pos), member); &pos->member != (head); \
+		pos = list_entry(pos->member.next, __typeof__(*pos), member))
+#define list_for_each_entry_safe(pos, n, head, member) \
+	for (pos = list_entry((head)->next, __typeof__(*pos), member), \
+		n = list_entry(pos->member.next, __typeof__(*pos), member); &pos->member != (head); \
+		pos = n, n = list_entry(n->member.next, __typeof__(*n), member))
+
+static inline void hlist_add_head(struct hlist_node *n, struct hlist_head *h) {
+	n->next = h->first;
+	if (h->first)
+		h->first->pprev = &n->next;
+	h->first = n;
+	n->pprev = &h->first;
+}
+
+static inline void hlist_del_init(struct hlist_node *n) {
+	if (n->pprev == NULL)
+		return;
+	*n->pprev = n->next;
+	if (n->next)
+		n->next->pprev = n->pprev;
+	n->next = NULL;
+	n->pprev = NULL;
+}
+
+#define hlist_entry_safe(ptr, type, member) ((ptr) ? container_of(ptr, type, member) : NULL)
+#define hlist_for_each_entry(pos, head, member) \
+	for (pos = hlist_entry_safe((head)->first, __typeof__(*pos), member); pos; \
+		pos = hlist_entry_safe(pos->member.next, __typeof__(*pos), member))
+
+#define DECLARE_HASHTABLE(name, bits) struct hlist_head name[1 << (bits)]
+#define hash_init(t) memset(t, 0, sizeof(t))
+#define hash_add(t, node, key) hlist_add_head(node, &t[(key) % ARRAY_SIZE(t)])
+#define hash_del(node) hlist_del_init(node)
+#define hash_for_each_possible(t, obj, member, key) hlist_for_each_entry(obj, &t[(key) % ARRAY_SIZE(t)], member)
+
+/* memory */
+static inline void *kmalloc(size_t size, gfp_t flags) {
+	return malloc(size);
+}
+
+static inline void *kzalloc(size_t size, gfp_t flags) {
+	return calloc(1, size);
+}
+
+static inline void *kmemdup(const void *src, size_t size, gfp_t flags) {
+	void *p = malloc(size);
+
+	if (p)
+		memcpy(p, src, size);
+	return p;
+}
+
+static inline void kfree(const void *p) {
+	free((void *)p);
+}
+
+/* locks, one thread runs everything so they are always free */
+struct mutex {
+	int locked;
+};
+
+static inline void mutex_init(struct mutex *m) {
+	m->locked = 0;
+}
+
+static inline int mutex_trylock(struct mutex *m) {
+	m->locked = 1;
+	return 1;
+}
+
+static inline void mutex_lock(struct mutex *m) {
+	m->locked = 1;
+}
+
+static inline int mutex_lock_interruptible(struct mutex *m) {
+	m->locked = 1;
+	return 0;
+}
+
+static inline void mutex_unlock(struct mutex *m) {
+	m->locked = 0;
+}
+
+typedef struct {
+	int locked;
+} spinlock_t;
+
+#define lockdep_is_held(l) 1
+#define lockdep_assert_held(l) do { } while (0)
+
+typedef struct {
+	int counter;
+} atomic_t;
+
+typedef struct {
+	long long counter;
+} atomic64_t;
+
+#define ATOMIC_INIT(i) { (i) }
+#define ATOMIC64_INIT(i) { (i) }
+
+static inline int atomic_read(const atomic_t *a) {
+	return a->counter;
+}
+
+static inline void atomic_set(atomic_t *a, int v) {
+	a->counter = v;
+}
+
+static inline int atomic_cmpxchg(atomic_t *a, int old, int new) {
+	int cur = a->counter;
+
+	if (cur == old)
+		a->counter = new;
+	return cur;
+}
+
+static inline long long atomic64_inc_return(atomic64_t *a) {
+	return ++a->counter;
+}
+
+#define smp_mb() do { } while (0)
+
+/* rcu and kref, nothing runs concurrently so a grace period is immediate */
+struct rcu_head {
+	void *unused;
+};
+
+#define rcu_read_lock() do { } while (0)
+#define rcu_read_unlock() do { } while (0)
+#define rcu_dereference(p) (p)
+#define rcu_dereference_protected(p, c) (p)
+#define rcu_assign_pointer(p, v) ((p) = (v))
+#define RCU_INIT_POINTER(p, v) ((p) = (v))
+#define kfree_rcu(p, f) kfree(p)
+
+struct kref {
+	atomic_t refcount;
+};
+
+/* time */
+static inline u64 ktime_get_ns(void) {
+	return sim_now;
+}
+
+// one jiffy is one ms of virtual time
+static inline unsigned long msecs_to_jiffies(unsigned int ms) {
+	return ms;
+}
+
+/* threads and wait queues, the simulation calls the step functions itself */
+struct task_struct;
+struct proc_dir_entry;
+
+typedef struct {
+	int unused;
+} wait_queue_head_t;
+
+static inline void wake_up(wait_queue_head_t *wq) {
+}
+
+static inline int kthread_should_stop(void) {
+	return 1;
+}
+
+static inline long sim_no_wait(void) {
+	return 0;
+}
+
+#define wait_event_interruptible(wq, cond) sim_no_wait()
+#define wait_event_interruptible_timeout(wq, cond, t) sim_no_wait()
+
+struct cpumask {
+	unsigned long bits[1];
+};
+typedef struct cpumask cpumask_var_t[1];
+
+/*
+	Delayed work runs when the simulation reaches due, pending is cleared just before.
+*/
+struct work_struct {
+	void (*func)(struct work_struct *);
+};
+
+struct delayed_work {
+	struct work_struct work;
+	int pending;
+	u64 due;
+};
+
+struct workqueue_struct;
+
+#define INIT_DELAYED_WORK(w, f) ((w)->work.func = (f), (w)->pending = 0)
+#define to_delayed_work(w) container_of(w, struct delayed_work, work)
+
+static inline int queue_delayed_work(struct workqueue_struct *wq, struct delayed_work *w, unsigned long delay) {
+	if (w->pending)
+		return 0;
+	w->pending = 1;
+	w->due = sim_now + (u64)delay * NSEC_PER_MSEC;
+	return 1;
+}
+
+static inline int mod_delayed_work(struct workqueue_struct *wq, struct delayed_work *w, unsigned long delay) {
+	int was = w->pending;
+
+	w->pending = 1;
+	w->due = sim_now + (u64)delay * NSEC_PER_MSEC;
+	return was;
+}
+
+/* module */
+#define MODULE_PARM_DESC(name, desc)
+#define module_param(name, type, perm)
+#define module_param_array(name, type, num, perm)
+
+/* ioctl numbers of elevator_uapi.h */
+#define _IOC(dir, type, nr, size) ((unsigned int)(((dir) << 30) | ((type) << 8) | (nr) | ((size) << 16)))
+#define _IO(t, n) _IOC(0, (t), (n), 0)
+#define _IOR(t, n, s) _IOC(2, (t), (n), sizeof(s))
+#define _IOW(t, n, s) _IOC(1, (t), (n), sizeof(s))
+#define _IOWR(t, n, s) _IOC(3, (t), (n), sizeof(s))
+
+#endif
@@ -0,0 +1,527 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sim.h"
+
+/*
+	Monte Carlo sweep of the scheduler over a grid of settings.
+	The scenario gives the workload and the settings every configuration starts from,
+	each key=v1/v2/... argument is an axis of the grid, and every configuration of the
+	grid runs the same seeds. The mean metrics of each configuration are ranked, and
+	the Pareto frontier of throughput against p99 wait is printed as settings to load
+	the module with.
+
+	./sweep.x [-j workers] [-n seeds] [-s seed] [-r metric] [-t top] [-c] scenario key=value/value...
+	e.g. ./sweep.x -n 50 scenarios/interfloor.scn dwell_max_ms=0/2500/5000/10000 \
+		aging_wait_weight=0/1/2/4 max_wait=0,0,30,60/0,0,15,30/0,0,0,0
+
+	The scheduler keeps its parameters and virtual clock in globals, so the workers are
+	processes. Each starts with a contiguous share of the runs, takes them one at a time
+	from the front and, once out of work, steals the back half of the largest share left.
+	A share is one word holding begin and end, so taking and stealing are both one
+	compare and swap on shared memory. Runs differ a lot in cost (a saturated car runs
+	for the whole drain limit) and neighbouring configurations cost about the same, so
+	without stealing a worker with a slow corner of the grid finishes long after the rest.
+*/
+
+#define MAX_AXES 16
+#define MAX_VALUES 64
+#define MAX_WORKERS 256
+#define MAX_METRICS 32
+#define MAX_TASKS (1 << 24)
+
+#define RANGE(begin, end) (((uint64_t)(begin) << 32) | (end))
+#define BEGIN(r) ((uint32_t)((r) >> 32))
+#define END(r) ((uint32_t)(r))
+
+// run states
+#define RUN_OK 1
+#define RUN_BAD_CONFIG 2
+#define RUN_BAD_WORKLOAD 3
+
+struct axis {
+	const char *key;
+	char *values[MAX_VALUES];
+	int n;
+};
+
+// one cache line per worker, thieves only touch the range of their victim
+struct worker {
+	uint64_t range;
+	uint64_t runs;
+	uint64_t steals;
+} __attribute__((aligned(64)));
+
+// shared by all workers
+struct pool {
+	struct worker workers[MAX_WORKERS];
+	struct sim_result *results;
+	int *state;
+};
+
+struct config {
+	int index;
+	int runs;
+	int invalid;
+	int frontier;
+	double mean[MAX_METRICS];
+	double ci[MAX_METRICS];
+};
+
+static struct axis axes[MAX_AXES];
+static int num_axes;
+static struct sim_workload base_workload;
+static struct sim_params base_params;
+static int seeds = 10;
+static const struct sim_metric *rank_metric;
+
+/*
+	Split a copy of @arg, key=value/value..., into an axis. Returns 0, or -1 if it is not one.
+*/
+static int parse_axis(const char *arg, struct axis *a) {
+	struct sim_workload w;
+	struct sim_params p;
+	char *copy, *eq, *tok, *save;
+
+	copy = strdup(arg);
+	eq = copy ? strchr(copy, '=') : NULL;
+	if (eq == NULL)
+		return -1;
+	*eq = '\0';
+	a->key = copy;
+	a->n = 0;
+	for (tok = strtok_r(eq + 1, "/", &save); tok != NULL; tok = strtok_r(NULL, "/", &save)) {
+		w = base_workload;
+		p = base_params;
+		if (a->n == MAX_VALUES || parse_setting(a->key, tok, &w, &p))
+			return -1;
+		a->values[a->n++] = tok;
+	}
+	return a->n ? 0 : -1;
+}
+
+/*
+	Settings of configuration @index, the last axis changes fastest.
+*/
+static void config_settings(int index, struct sim_workload *w, struct sim_params *p) {
+	int i;
+
+	*w = base_workload;
+	*p = base_params;
+	for (i = num_axes - 1; i >= 0; i--) {
+		parse_setting(axes[i].key, axes[i].values[index % axes[i].n], w, p);
+		index /= axes[i].n;
+	}
+}
+
+static void print_settings(FILE *f, int index) {
+	int value[MAX_AXES];
+	int i;
+
+	for (i = num_axes - 1; i >= 0; i--) {
+		value[i] = index % axes[i].n;
+		index /= axes[i].n;
+	}
+	if (num_axes == 0)
+		fprintf(f, "(scenario settings)");
+	for (i = 0; i < num_axes; i++)
+		fprintf(f, "%s%s=%s", i ? " " : "", axes[i].key, axes[i].values[value[i]]);
+}
+
+static void run_task(struct pool *pool, uint32_t task) {
+	struct sim_workload w;
+	struct sim_params p;
+	struct sim_arrival *arrivals;
+	int n;
+
+	config_settings(task / seeds, &w, &p);
+	w.seed += task % seeds;
+	n = make_workload(&w, &arrivals);
+	if (n < 0) {
+		pool->state[task] = RUN_BAD_WORKLOAD;
+		return;
+	}
+	pool->state[task] = sim_run(&p, arrivals, n, &pool->results[task]) ? RUN_BAD_CONFIG : RUN_OK;
+	free(arrivals);
+}
+
+/*
+	Take the first run of our own range. Returns 1 with it in @task, 0 if the range is empty.
+*/
+static int take(struct worker *self, uint32_t *task) {
+	uint64_t old = __atomic_load_n(&self->range, __ATOMIC_ACQUIRE);
+
+	while (BEGIN(old) < END(old)) {
+		if (__atomic_compare_exchange_n(&self->range, &old, RANGE(BEGIN(old) + 1, END(old)), 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			*task = BEGIN(old);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+	Move the back half of the largest range left into our own, which is empty.
+	Returns 0 once every range is empty.
+*/
+static int steal(struct pool *pool, int self, int workers) {
+	uint64_t old;
+	uint32_t left, most, mid;
+	int victim;
+	int i;
+
+	for (;;) {
+		victim = -1;
+		most = 0;
+		for (i = 0; i < workers; i++) {
+			old = __atomic_load_n(&pool->workers[i].range, __ATOMIC_ACQUIRE);
+			left = END(old) - BEGIN(old);
+			if (i != self && BEGIN(old) < END(old) && left > most) {
+				most = left;
+				victim = i;
+			}
+		}
+		if (victim < 0)
+			return 0;
+
+		old = __atomic_load_n(&pool->workers[victim].range, __ATOMIC_ACQUIRE);
+		if (BEGIN(old) >= END(old))
+			continue;
+		mid = END(old) - (END(old) - BEGIN(old) + 1) / 2;
+		if (__atomic_compare_exchange_n(&pool->workers[victim].range, &old, RANGE(BEGIN(old), mid), 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			__atomic_store_n(&pool->workers[self].range, RANGE(mid, END(old)), __ATOMIC_RELEASE);
+			pool->workers[self].steals++;
+			return 1;
+		}
+	}
+}
+
+static void worker_main(struct pool *pool, int self, int workers) {
+	uint32_t task;
+
+	do {
+		while (take(&pool->workers[self], &task)) {
+			run_task(pool, task);
+			pool->workers[self].runs++;
+		}
+	} while (steal(pool, self, workers));
+}
+
+/*
+	Run @tasks runs on @workers processes. Returns 0, or -1 if a worker failed.
+*/
+static int run_pool(struct pool *pool, uint32_t tasks, int workers) {
+	pid_t pids[MAX_WORKERS];
+	uint32_t begin, end;
+	int status;
+	int failed = 0;
+	int i;
+
+	for (i = 0; i < workers; i++) {
+		begin = (uint64_t)tasks * i / workers;
+		end = (uint64_t)tasks * (i + 1) / workers;
+		pool->workers[i].range = RANGE(begin, end);
+	}
+	fflush(stdout);
+	for (i = 0; i < workers; i++) {
+		pids[i] = fork();
+		if (pids[i] < 0) {
+			perror("fork");
+			// the ones started steal the work of the rest
+			workers = i;
+			failed = i == 0;
+			break;
+		}
+		if (pids[i] == 0) {
+			worker_main(pool, i, workers);
+			_exit(0);
+		}
+	}
+	for (i = 0; i < workers; i++) {
+		if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+			failed = 1;
+	}
+	return failed ? -1 : 0;
+}
+
+/*
+	Mean and 95% confidence half width of every metric over the seeds of @c.
+*/
+static void aggregate(struct pool *pool, struct config *c) {
+	struct sim_result *r;
+	double v, sum[MAX_METRICS] = {0}, sq[MAX_METRICS] = {0};
+	uint32_t task;
+	int i, s;
+
+	c->runs = 0;
+	c->invalid = 0;
+	for (s = 0; s < seeds; s++) {
+		task = (uint32_t)c->index * seeds + s;
+		if (pool->state[task] != RUN_OK) {
+			c->invalid++;
+			continue;
+		}
+		r = &pool->results[task];
+		for (i = 0; i < num_sim_metrics; i++) {
+			v = metric_value(r, &sim_metric_table[i]);
+			sum[i] += v;
+			sq[i] += v * v;
+		}
+		c->runs++;
+	}
+	for (i = 0; i < num_sim_metrics; i++) {
+		c->mean[i] = c->runs ? sum[i] / c->runs : 0;
+		c->ci[i] = 0;
+		if (c->runs > 1)
+			c->ci[i] = 1.96 * sqrt(fmax(0, (sq[i] - c->runs * c->mean[i] * c->mean[i]) / (c->runs - 1)) / c->runs);
+	}
+}
+
+static int metric_index(const char *name) {
+	return (int)(find_metric(name) - sim_metric_table);
+}
+
+// configurations that lose or refuse passengers are no candidates, whatever their numbers
+static int complete(const struct config *c) {
+	return c->invalid == 0 && c->mean[metric_index("dropped")] == 0 && c->mean[metric_index("rejected")] == 0;
+}
+
+static int cmp_rank(const void *x, const void *y) {
+	const struct config *a = x, *b = y;
+	int i = (int)(rank_metric - sim_metric_table);
+
+	if (complete(a) != complete(b))
+		return complete(a) ? -1 : 1;
+	if (a->mean[i] != b->mean[i])
+		return (a->mean[i] < b->mean[i]) == rank_metric->lower_better ? -1 : 1;
+	return a->index - b->index;
+}
+
+// throughput down, then p99 wait up
+static int cmp_throughput(const void *x, const void *y) {
+	const struct config *a = *(const struct config **)x, *b = *(const struct config **)y;
+	int t = metric_index("throughput"), w = metric_index("wait_p99");
+
+	if (a->mean[t] != b->mean[t])
+		return a->mean[t] > b->mean[t] ? -1 : 1;
+	if (a->mean[w] != b->mean[w])
+		return a->mean[w] < b->mean[w] ? -1 : 1;
+	return a->index - b->index;
+}
+
+/*
+	Mark the complete configurations no other one beats on both throughput and p99 wait.
+	Returns how many, with them in @front from the highest throughput down.
+*/
+static int pareto(struct config *configs, int n, struct config **front) {
+	struct config **sorted;
+	double best = INFINITY;
+	int w = metric_index("wait_p99");
+	int count = 0, m = 0;
+	int i;
+
+	sorted = malloc(n * sizeof(*sorted));
+	if (sorted == NULL)
+		return 0;
+	for (i = 0; i < n; i++) {
+		if (complete(&configs[i]))
+			sorted[m++] = &configs[i];
+	}
+	qsort(sorted, m, sizeof(*sorted), cmp_throughput);
+	for (i = 0; i < m; i++) {
+		if (sorted[i]->mean[w] < best) {
+			best = sorted[i]->mean[w];
+			sorted[i]->frontier = 1;
+			front[count++] = sorted[i];
+		}
+	}
+	free(sorted);
+	return count;
+}
+
+static const char *columns[] = {"throughput", "wait_p99", "wait_mean", "deadline_miss", "dropped"};
+#define NUM_COLUMNS ((int)(sizeof(columns) / sizeof(columns[0])))
+
+static void print_row(const struct config *c, int extra) {
+	int i, m;
+
+	for (i = 0; i < NUM_COLUMNS; i++) {
+		m = metric_index(columns[i]);
+		if (i < 2)
+			printf(" %9.3f +-%-7.3f", c->mean[m], c->ci[m]);
+		else
+			printf(" %13.3f", c->mean[m]);
+	}
+	if (extra >= 0)
+		printf(" %13.3f", c->mean[extra]);
+	printf("  ");
+	print_settings(stdout, c->index);
+	if (c->invalid)
+		printf(" (%d runs invalid)", c->invalid);
+	printf("\n");
+}
+
+static void print_header(int extra) {
+	int i;
+
+	printf("\t%4s", "rank");
+	for (i = 0; i < NUM_COLUMNS; i++)
+		printf(i < 2 ? " %19s" : " %13s", columns[i]);
+	if (extra >= 0)
+		printf(" %13s", sim_metric_table[extra].name);
+	printf("  settings\n");
+}
+
+static void print_csv(struct config *configs, int n) {
+	int i, k;
+
+	printf("config,runs,invalid,frontier");
+	for (k = 0; k < num_sim_metrics; k++)
+		printf(",%s", sim_metric_table[k].name);
+	printf(",settings\n");
+	for (i = 0; i < n; i++) {
+		printf("%d,%d,%d,%d", configs[i].index, configs[i].runs, configs[i].invalid, configs[i].frontier);
+		for (k = 0; k < num_sim_metrics; k++)
+			printf(",%.6g", configs[i].mean[k]);
+		printf(",\"");
+		print_settings(stdout, configs[i].index);
+		printf("\"\n");
+	}
+}
+
+static void usage(const char *name) {
+	printf("usage: %s [-j workers] [-n seeds] [-s seed] [-r metric] [-t top] [-c] scenario key=value/value...\n", name);
+}
+
+int main(int argc, char **argv) {
+	struct pool *pool;
+	struct config *configs, **front;
+	struct timespec start, stop;
+	uint64_t steals = 0, min_runs = UINT64_MAX, max_runs = 0;
+	unsigned long long seed = 0;
+	int seed_set = 0;
+	size_t size;
+	long num_configs = 1;
+	uint32_t tasks;
+	int workers = sysconf(_SC_NPROCESSORS_ONLN);
+	int top = 20;
+	int csv = 0;
+	int extra = -1;
+	int num_front;
+	int opt;
+	int i;
+
+	rank_metric = find_metric("wait_p99");
+	base_workload.seed = 1;
+	sim_params_init(&base_params);
+	while ((opt = getopt(argc, argv, "j:n:s:r:t:c")) != -1) {
+		switch (opt) {
+		case 'j': workers = atoi(optarg); break;
+		case 'n': seeds = atoi(optarg); break;
+		case 's': seed = strtoull(optarg, NULL, 0); seed_set = 1; break;
+		case 'r': rank_metric = find_metric(optarg); break;
+		case 't': top = atoi(optarg); break;
+		case 'c': csv = 1; break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if (optind == argc || workers < 1 || seeds < 1 || rank_metric == NULL) {
+		usage(argv[0]);
+		return 2;
+	}
+	if (workers > MAX_WORKERS)
+		workers = MAX_WORKERS;
+	if (num_sim_metrics > MAX_METRICS) {
+		printf("more than %d metrics, raise MAX_METRICS\n", MAX_METRICS);
+		return 2;
+	}
+	if (load_settings(argv[optind], &base_workload, &base_params))
+		return 2;
+	// -s wins over the seed of the scenario
+	if (seed_set)
+		base_workload.seed = seed;
+	for (i = optind + 1; i < argc; i++) {
+		if (num_axes == MAX_AXES || parse_axis(argv[i], &axes[num_axes])) {
+			printf("bad axis %s\n", argv[i]);
+			return 2;
+		}
+		num_configs *= axes[num_axes++].n;
+		if (num_configs * seeds > MAX_TASKS) {
+			printf("more than %d runs\n", MAX_TASKS);
+			return 2;
+		}
+	}
+	tasks = num_configs * seeds;
+	if ((uint32_t)workers > tasks)
+		workers = tasks;
+
+	size = sizeof(struct pool) + tasks * (sizeof(struct sim_result) + sizeof(int));
+	pool = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	configs = calloc(num_configs, sizeof(*configs));
+	front = calloc(num_configs, sizeof(*front));
+	if (pool == MAP_FAILED || configs == NULL || front == NULL) {
+		printf("out of memory for %u runs\n", tasks);
+		return 2;
+	}
+	pool->results = (struct sim_result *)(pool + 1);
+	pool->state = (int *)(pool->results + tasks);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	if (run_pool(pool, tasks, workers)) {
+		printf("a worker failed\n");
+		return 2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &stop);
+
+	for (i = 0; i < workers; i++) {
+		steals += pool->workers[i].steals;
+		min_runs = pool->workers[i].runs < min_runs ? pool->workers[i].runs : min_runs;
+		max_runs = pool->workers[i].runs > max_runs ? pool->workers[i].runs : max_runs;
+	}
+	for (i = 0; i < num_configs; i++) {
+		configs[i].index = i;
+		aggregate(pool, &configs[i]);
+	}
+	qsort(configs, num_configs, sizeof(*configs), cmp_rank);
+	num_front = pareto(configs, num_configs, front);
+
+	if (csv) {
+		print_csv(configs, num_configs);
+		return 0;
+	}
+	printf("%s (%s): %s, %ld configurations x %d seeds from %llu = %u runs\n", argv[optind], sim_backend,
+		model_names[base_workload.model], num_configs, seeds, (unsigned long long)base_workload.seed, tasks);
+	printf("%d workers, %.2f s, %llu steals, %llu to %llu runs per worker\n", workers,
+		(stop.tv_sec - start.tv_sec) + (stop.tv_nsec - start.tv_nsec) / 1e9,
+		(unsigned long long)steals, (unsigned long long)min_runs, (unsigned long long)max_runs);
+
+	for (i = 0; i < NUM_COLUMNS; i++) {
+		if (rank_metric == find_metric(columns[i]))
+			break;
+	}
+	if (i == NUM_COLUMNS)
+		extra = (int)(rank_metric - sim_metric_table);
+	printf("\nranked by %s, * on the frontier\n", rank_metric->name);
+	print_header(extra);
+	for (i = 0; i < num_configs && i < top; i++) {
+		printf("\t%3d%s", i + 1, configs[i].frontier ? "*" : " ");
+		print_row(&configs[i], extra);
+	}
+
+	printf("\nPareto frontier, throughput against p99 wait\n");
+	print_header(-1);
+	for (i = 0; i < num_front; i++) {
+		printf("\t%4d", i + 1);
+		print_row(front[i], -1);
+	}
+	return 0;
+}
@@ -0,0 +1,151 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+
+/*
+	Seeded request lists, the same seed and model always give the same list.
+	poisson: exponential gaps, uniform start and destination
+	bursty: poisson in bursts at 5x the rate (20% of the time) and silence, same mean rate
+	uppeak: poisson, 90% from the lobby to a random floor
+	downpeak: poisson, 90% from a random floor to the lobby
+	stress: the mix of elevator4_stress_test, every request at once, 70% to the lobby
+	A same_floor share of the requests of any model is sent to its own start floor,
+	which the scheduler has to reject.
+*/
+
+#define BURST_FACTOR 5
+#define BURST_MEAN_S 0.2
+#define QUIET_MEAN_S 0.8
+
+const char *model_names[NUM_MODELS] = {"poisson", "bursty", "uppeak", "downpeak", "stress"};
+
+int parse_model(const char *name) {
+	int i;
+
+	for (i = 0; i < NUM_MODELS; i++) {
+		if (strcmp(model_names[i], name) == 0)
+			return i;
+	}
+	return -1;
+}
+
+/* splitmix64 */
+static uint64_t next_random(uint64_t *s) {
+	uint64_t z = (*s += 0x9e3779b97f4a7c15ULL);
+
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// uniform in (0, 1]
+static double uniform(uint64_t *s) {
+	return ((next_random(s) >> 11) + 1) * (1.0 / 9007199254740992.0);
+}
+
+static int rnd(uint64_t *s, int min, int max) {
+	return min + next_random(s) % (max - min + 1);
+}
+
+static double exponential(uint64_t *s, double mean) {
+	return -log(uniform(s)) * mean;
+}
+
+// any floor but @not
+static int other_floor(uint64_t *s, int min, int not) {
+	int f;
+
+	do {
+		f = rnd(s, min, SIM_FLOORS);
+	} while (f == not);
+	return f;
+}
+
+static void pick_floors(uint64_t *s, const struct sim_workload *w, struct sim_arrival *a) {
+	int model = w->model;
+
+	a->type = rnd(s, 1, SIM_TYPES);
+	a->start = rnd(s, 1, SIM_FLOORS);
+	a->dest = other_floor(s, 1, a->start);
+	if (model == MODEL_UPPEAK && rnd(s, 1, 100) <= 90) {
+		a->start = 1;
+		a->dest = rnd(s, 2, SIM_FLOORS);
+	}
+	else if (model == MODEL_DOWNPEAK && rnd(s, 1, 100) <= 90) {
+		a->start = rnd(s, 2, SIM_FLOORS);
+		a->dest = 1;
+	}
+	else if (model == MODEL_STRESS) {
+		if (a->start != 1 && rnd(s, 0, 100) <= 70)
+			a->dest = 1;
+		else
+			a->dest = other_floor(s, 2, a->start);
+	}
+	// drawn only when asked for, so other workloads keep their requests
+	if (w->same_floor > 0 && uniform(s) <= w->same_floor)
+		a->dest = a->start;
+}
+
+/*
+	Draw the requests of @w into @out, sorted by time.
+	Returns how many, or -1 if @w is not valid or out of memory.
+*/
+int make_workload(const struct sim_workload *w, struct sim_arrival **out) {
+	struct sim_arrival *a = NULL, *grown;
+	uint64_t s = w->seed;
+	double mean_gap;
+	double t = 0;
+	double phase_end = 0;
+	int size = 0;
+	int n = 0;
+
+	if (w->model < 0 || w->model >= NUM_MODELS || w->same_floor < 0 || w->same_floor > 1)
+		return -1;
+	if (w->model == MODEL_STRESS) {
+		if (w->requests <= 0)
+			return -1;
+		a = calloc(w->requests, sizeof(*a));
+		if (a == NULL)
+			return -1;
+		for (n = 0; n < w->requests; n++)
+			pick_floors(&s, w, &a[n]);
+		*out = a;
+		return n;
+	}
+	if (w->rate <= 0 || w->duration <= 0)
+		return -1;
+
+	mean_gap = 1 / w->rate;
+	if (w->model == MODEL_BURSTY)
+		phase_end = exponential(&s, BURST_MEAN_S);
+	for (;;) {
+		if (w->model == MODEL_BURSTY) {
+			t += exponential(&s, mean_gap / BURST_FACTOR);
+			while (t >= phase_end) {
+				t = phase_end + exponential(&s, QUIET_MEAN_S);
+				phase_end = t + exponential(&s, BURST_MEAN_S);
+				t += exponential(&s, mean_gap / BURST_FACTOR);
+			}
+		}
+		else {
+			t += exponential(&s, mean_gap);
+		}
+		if (t >= w->duration)
+			break;
+		if (n == size) {
+			size = size ? size * 2 : 1024;
+			grown = realloc(a, size * sizeof(*a));
+			if (grown == NULL) {
+				free(a);
+				return -1;
+			}
+			a = grown;
+		}
+		a[n].at_ns = (uint64_t)(t * 1e9);
+		pick_floors(&s, w, &a[n]);
+		n++;
+	}
+	*out = a;
+	return n;
+}
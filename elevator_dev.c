@@ -0,0 +1,637 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/capability.h>
+#include <linux/compat.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/hashtable.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+#include "elevator.h"
+#include "elevator_uapi.h"
+
+// requests copied in per lock hold by ELEVATOR_IOC_ISSUE_BATCH
+#define BATCH_CHUNK 64
+#define TICKET_HASH_BITS 10
+
+/*
+			/dev/elevator, the ioctl interface to the buildings.
+			The file holds a reference on the module through fops.owner and every
+			command holds a reference on its building, so neither can go away under
+			a call in flight.
+*/
+
+/*
+			Per open file state, the producer id stamped on its requests
+			and the tickets issued with ELEVATOR_ISSUE_TRACK.
+*/
+struct dev_file {
+	u64 producer;
+	struct mutex lock;
+	DECLARE_HASHTABLE(tickets, TICKET_HASH_BITS);
+	int count;
+};
+
+static atomic64_t producer_ids = ATOMIC64_INIT(0);
+
+/*
+			Id of a new producer of requests, never 0 which is the system calls.
+*/
+u64 new_producer_id(void){
+	return atomic64_inc_return(&producer_ids);
+}
+
+static void ticket_release(struct kref *ref){
+	kfree(container_of(ref, struct ticket, ref));
+}
+
+void ticket_put(struct ticket *tk){
+	kref_put(&tk->ref, ticket_release);
+}
+
+/*
+			Called by the scheduler as the passenger of @tk boards and leaves.
+			The durations are written before the state is released to the waiter.
+*/
+void ticket_update(struct ticket *tk, int state, u64 wait_ns, u64 ride_ns){
+	tk->wait_ns = wait_ns;
+	tk->ride_ns = ride_ns;
+	smp_store_release(&tk->state, state);
+	wake_up_interruptible(&tk->wait);
+}
+
+/*
+			Start tracking the ticket of @p for @df, before @p is queued.
+*/
+static int track_ticket(struct dev_file *df, struct building *b, Passenger *p){
+	struct ticket *tk;
+
+	tk = kzalloc(sizeof(struct ticket), GFP_KERNEL);
+	if (tk == NULL)
+		return -ENOMEM;
+	tk->id = p->ticket;
+	tk->building = b->id;
+	tk->state = ELEVATOR_TICKET_WAITING;
+	init_waitqueue_head(&tk->wait);
+	kref_init(&tk->ref);
+
+	mutex_lock(&df->lock);
+	if (df->count >= ELEVATOR_TICKETS_MAX){
+		mutex_unlock(&df->lock);
+		kfree(tk);
+		return -EAGAIN;
+	}
+	df->count++;
+	hash_add(df->tickets, &tk->node, tk->id);
+	mutex_unlock(&df->lock);
+
+	// second reference for the passenger, dropped in release_passenger()
+	kref_get(&tk->ref);
+	p->tk = tk;
+	return 0;
+}
+
+static struct ticket *find_ticket(struct dev_file *df, int building, u64 id){
+	struct ticket *tk;
+
+	hash_for_each_possible(df->tickets, tk, node, id){
+		if (tk->id == id && tk->building == building)
+			return tk;
+	}
+	return NULL;
+}
+
+static void forget_ticket(struct dev_file *df, struct ticket *tk){
+	hash_del(&tk->node);
+	df->count--;
+	ticket_put(tk);
+}
+
+static long dev_start(u32 __user *arg){
+	struct building *b;
+	u32 id;
+	long ret;
+
+	if (get_user(id, arg))
+		return -EFAULT;
+	b = building_get(id);
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_start(b);
+	building_put(b);
+	return ret;
+}
+
+/*
+			ELEVATOR_IOC_RESET, zero the counters and rates of a running building
+*/
+static long dev_reset(u32 __user *arg){
+	struct building *b;
+	u32 id;
+	long ret;
+
+	if (get_user(id, arg))
+		return -EFAULT;
+	b = building_get(id);
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_reset_counters(b);
+	building_put(b);
+	return ret;
+}
+
+static long dev_stop(u32 __user *arg){
+	struct building *b;
+	u32 id;
+	long ret;
+
+	if (get_user(id, arg))
+		return -EFAULT;
+	b = building_get(id);
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_stop(b);
+	building_put(b);
+	return ret;
+}
+
+static long dev_issue(struct dev_file *df, struct elevator_issue __user *arg){
+	struct elevator_issue issue;
+	struct building *b;
+	Passenger *p;
+	long ret;
+
+	if (copy_from_user(&issue, arg, sizeof(issue)))
+		return -EFAULT;
+	b = building_get(issue.building);
+	if (b == NULL)
+		return -ENODEV;
+	issue.req.ticket = 0;
+	ret = make_passenger(b, issue.req.type, issue.req.start, issue.req.dest, &p);
+	if (ret == 0 && (issue.flags & ELEVATOR_ISSUE_TRACK)){
+		ret = track_ticket(df, b, p);
+		if (ret)
+			release_passenger(p, RELEASE_DROPPED);
+	}
+	if (ret == 0){
+		p->producer = df->producer;
+		issue.req.ticket = p->ticket;
+		elevator_queue(b, p);
+	}
+	building_put(b);
+	if (ret < 0)
+		return ret;
+
+	issue.req.res = ret;
+	if (copy_to_user(&arg->req, &issue.req, sizeof(issue.req)))
+		return -EFAULT;
+	return ret;
+}
+
+/*
+			Queue the requests chunk by chunk, one lock hold and one kick per chunk.
+			Returns the number of requests queued.
+*/
+static long dev_issue_batch(struct dev_file *df, struct elevator_batch __user *arg){
+	struct elevator_batch batch;
+	struct elevator_request *reqs;
+	struct elevator_request __user *ureqs;
+	struct list_head list;
+	struct building *b;
+	Passenger *p;
+	long queued = 0;
+	long ret = 0;
+	u32 done;
+	u32 n;
+	u32 i;
+
+	if (copy_from_user(&batch, arg, sizeof(batch)))
+		return -EFAULT;
+	if (batch.count > ELEVATOR_BATCH_MAX)
+		return -EINVAL;
+	ureqs = u64_to_user_ptr(batch.requests);
+
+	b = building_get(batch.building);
+	if (b == NULL)
+		return -ENODEV;
+	reqs = kmalloc_array(BATCH_CHUNK, sizeof(struct elevator_request), GFP_KERNEL);
+	if (reqs == NULL){
+		building_put(b);
+		return -ENOMEM;
+	}
+
+	for (done = 0; done < batch.count; done += n){
+		n = min_t(u32, batch.count - done, BATCH_CHUNK);
+		if (copy_from_user(reqs, ureqs + done, n * sizeof(struct elevator_request))){
+			ret = -EFAULT;
+			break;
+		}
+		INIT_LIST_HEAD(&list);
+		for (i = 0; i < n; ++i){
+			reqs[i].ticket = 0;
+			reqs[i].res = make_passenger(b, reqs[i].type, reqs[i].start, reqs[i].dest, &p);
+			if (reqs[i].res == 0 && (batch.flags & ELEVATOR_ISSUE_TRACK)){
+				reqs[i].res = track_ticket(df, b, p);
+				if (reqs[i].res)
+					release_passenger(p, RELEASE_DROPPED);
+			}
+			if (reqs[i].res == 0){
+				p->producer = df->producer;
+				reqs[i].ticket = p->ticket;
+				list_add_tail(&p->list, &list);
+				queued++;
+			}
+		}
+		elevator_queue_batch(b, &list);
+		if (copy_to_user(ureqs + done, reqs, n * sizeof(struct elevator_request))){
+			ret = -EFAULT;
+			break;
+		}
+	}
+
+	kfree(reqs);
+	building_put(b);
+	return ret < 0 ? ret : queued;
+}
+
+static long dev_stats(struct elevator_stats __user *arg){
+	struct elevator_stats st;
+	struct building *b;
+	u64 now;
+	int i, w;
+
+	BUILD_BUG_ON(ELEVATOR_NUM_FLOORS != NUM_FLOORS);
+	BUILD_BUG_ON(ELEVATOR_NUM_CLASSES != NUM_CLASSES);
+	BUILD_BUG_ON(ELEVATOR_NUM_STATUS != NUM_STATUS);
+	BUILD_BUG_ON(ELEVATOR_RATE_WINDOWS != RATE_WINDOWS);
+	// same layout for 32 bit user space, which aligns __u64 to 4
+	BUILD_BUG_ON(offsetof(struct elevator_stats, longest_wait_ns) % 8);
+	BUILD_BUG_ON(sizeof(struct elevator_stats) % 8);
+
+	if (copy_from_user(&st.building, &arg->building, sizeof(st.building)))
+		return -EFAULT;
+	b = building_get(st.building);
+	if (b == NULL)
+		return -ENODEV;
+
+	memset(&st, 0, sizeof(st));
+	st.building = b->id;
+	elevator_lock(b, LOCK_SITE_STATS);
+	floors_lock(b, LOCK_SITE_STATS);
+	st.status = b->elevator.status;
+	st.phase = b->elevator.phase;
+	st.floor = b->elevator.floor;
+	st.next_stop = b->elevator.next_stop;
+	st.weight_load = b->elevator.w_load;
+	st.unit_load = b->elevator.unit_load;
+	st.serviced = b->elevator.serviced;
+	for (i = 0; i < NUM_FLOORS; ++i){
+		st.served_per_floor[i] = b->elevator.served_per_fl[i];
+		st.waiting_weight[i] = floor_w_load(b, i);
+		st.waiting_units[i] = floor_u_load(b, i);
+	}
+	for (i = 0; i < NUM_CLASSES; ++i){
+		st.boarded_per_class[i] = b->elevator.boarded_per_class[i];
+		st.deadline_miss[i] = b->elevator.deadline_miss[i];
+	}
+	st.p99_wait_s = wait_percentile(b, 99);
+	st.longest_wait_ns = b->elevator.longest_wait;
+	st.cancelled = b->elevator.cancelled;
+	st.stops_avoided = b->elevator.stops_avoided;
+	st.holds = b->elevator.holds;
+	st.held_boarded = b->elevator.held_boarded;
+	st.hold_ns = b->elevator.hold_ns;
+	st.departures = b->elevator.departures;
+	st.load_factor_pct = load_factor(b);
+	st.traffic_mode = b->traffic_mode;
+	st.traffic_switches = b->traffic_switches;
+	st.last_shutdown_ns = b->elevator.last_shutdown_ns;
+	st.dropped = b->elevator.dropped;
+	st.drain_plan_ms = b->elevator.drain_plan_ms;
+	st.drain_plan_floors = b->elevator.drain_plan_floors;
+	st.drain_floors = b->elevator.drain_floors;
+	now = ktime_get_ns();
+	for (i = 0; i < NUM_STATUS; ++i)
+		st.status_ns[i] = status_time(b, i, now);
+	st.floors_loaded = b->elevator.floors_loaded;
+	st.floors_empty = b->elevator.floors_empty;
+	st.stops_boarded = b->elevator.stops_boarded;
+	st.stops_unboarded = b->elevator.stops_unboarded;
+	st.weight_factor_pct = weight_factor(b);
+	rates_advance(b, now);
+	for (w = 0; w < RATE_WINDOWS; ++w){
+		st.accepted_rate[w] = ((u64)b->accepted.avg[w] * 1000) >> RATE_SHIFT;
+		st.delivered_rate[w] = ((u64)b->delivered.avg[w] * 60000) >> RATE_SHIFT;
+		for (i = 0; i < NUM_FLOORS; ++i){
+			st.floor_accepted_rate[i][w] = ((u64)b->floor_accepted[i].avg[w] * 1000) >> RATE_SHIFT;
+			st.floor_delivered_rate[i][w] = ((u64)b->floor_delivered[i].avg[w] * 60000) >> RATE_SHIFT;
+		}
+	}
+	floors_unlock(b);
+	elevator_unlock(b);
+	building_put(b);
+
+	if (copy_to_user(arg, &st, sizeof(st)))
+		return -EFAULT;
+	return 0;
+}
+
+/*
+			ELEVATOR_IOC_SAMPLES, too big for the stack
+*/
+static long dev_samples(struct elevator_samples __user *arg){
+	struct elevator_samples *sa;
+	struct queue_stats *qs;
+	struct building *b;
+	u32 id;
+	u64 n;
+	u64 i;
+	int f;
+	long ret = 0;
+
+	BUILD_BUG_ON(ELEVATOR_SAMPLES != SAMPLE_RING);
+
+	if (get_user(id, &arg->building))
+		return -EFAULT;
+	b = building_get(id);
+	if (b == NULL)
+		return -ENODEV;
+	sa = kzalloc(sizeof(struct elevator_samples), GFP_KERNEL);
+	if (sa == NULL){
+		building_put(b);
+		return -ENOMEM;
+	}
+
+	sa->building = b->id;
+	floors_lock(b, LOCK_SITE_STATS);
+	sample_floors(b, ktime_get_ns());
+	sa->interval_ms = div64_u64(b->sample_ns, NSEC_PER_MSEC);
+	sa->taken = b->samples;
+	sa->last_ns = b->sample_next - b->sample_ns;
+	n = min_t(u64, b->samples, SAMPLE_RING);
+	for (f = 0; f < NUM_FLOORS; ++f){
+		qs = &b->queue_stats[f];
+		if (b->samples){
+			sa->queue_min[f] = qs->min_queue;
+			sa->queue_avg[f] = div64_u64(qs->sum_queue * 1000, b->samples);
+			sa->queue_max[f] = qs->max_queue;
+			sa->age_min_ms[f] = qs->min_age_ms;
+			sa->age_avg_ms[f] = div64_u64(qs->sum_age_ms * 1000, b->samples);
+			sa->age_max_ms[f] = qs->max_age_ms;
+		}
+		for (i = 0; i < n; ++i){
+			sa->series[f][i].queue = b->sample_ring[f][(b->samples - n + i) % SAMPLE_RING].queue;
+			sa->series[f][i].age_ms = b->sample_ring[f][(b->samples - n + i) % SAMPLE_RING].age_ms;
+		}
+	}
+	floors_unlock(b);
+	building_put(b);
+
+	if (copy_to_user(arg, sa, sizeof(struct elevator_samples)))
+		ret = -EFAULT;
+	kfree(sa);
+	return ret;
+}
+
+/*
+			Block until the ticket reaches the requested state, the durations are
+			filled in as far as it got. A ticket is forgotten once it is final.
+*/
+static long dev_ticket_wait(struct dev_file *df, struct elevator_ticket_wait __user *arg){
+	struct elevator_ticket_wait tw;
+	struct ticket *tk;
+	long timeout;
+	long ret = 0;
+
+	if (copy_from_user(&tw, arg, sizeof(tw)))
+		return -EFAULT;
+	if (tw.until != ELEVATOR_TICKET_BOARDED && tw.until != ELEVATOR_TICKET_DELIVERED)
+		return -EINVAL;
+
+	mutex_lock(&df->lock);
+	tk = find_ticket(df, tw.building, tw.ticket);
+	if (tk != NULL)
+		kref_get(&tk->ref);
+	mutex_unlock(&df->lock);
+	if (tk == NULL)
+		return -ENOENT;
+
+	timeout = tw.timeout_ms < 0 ? MAX_SCHEDULE_TIMEOUT : msecs_to_jiffies(tw.timeout_ms);
+	if (smp_load_acquire(&tk->state) < tw.until){
+		if (timeout == 0)
+			ret = -ETIMEDOUT;
+		else {
+			timeout = wait_event_interruptible_timeout(tk->wait, smp_load_acquire(&tk->state) >= tw.until, timeout);
+			if (timeout < 0)
+				ret = timeout;
+			else if (timeout == 0)
+				ret = -ETIMEDOUT;
+		}
+	}
+
+	tw.state = smp_load_acquire(&tk->state);
+	tw.wait_ns = tk->wait_ns;
+	tw.ride_ns = tk->ride_ns;
+	if (tw.state >= ELEVATOR_TICKET_DELIVERED){
+		mutex_lock(&df->lock);
+		if (!hlist_unhashed(&tk->node))
+			forget_ticket(df, tk);
+		mutex_unlock(&df->lock);
+	}
+	ticket_put(tk);
+
+	if (copy_to_user(arg, &tw, sizeof(tw)))
+		return -EFAULT;
+	return ret;
+}
+
+static int owns_ticket(struct dev_file *df, int building, u64 id){
+	int found;
+
+	mutex_lock(&df->lock);
+	found = find_ticket(df, building, id) != NULL;
+	mutex_unlock(&df->lock);
+	return found;
+}
+
+/*
+			Anyone may cancel what they issued through this file, cancelling other
+			users' requests takes CAP_SYS_ADMIN.
+*/
+static long dev_cancel(struct dev_file *df, struct elevator_cancel __user *arg){
+	struct elevator_cancel cancel;
+	struct building *b;
+	int avoided = 0;
+	long ret;
+
+	if (copy_from_user(&cancel, arg, sizeof(cancel)))
+		return -EFAULT;
+	if (cancel.by == ELEVATOR_CANCEL_PRODUCER)
+		cancel.key = df->producer;
+	else if (!capable(CAP_SYS_ADMIN) && !(cancel.by == ELEVATOR_CANCEL_TICKET && owns_ticket(df, cancel.building, cancel.key)))
+		return -EPERM;
+	b = building_get(cancel.building);
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_cancel(b, cancel.by, cancel.key, &avoided);
+	building_put(b);
+	if (ret < 0)
+		return ret;
+
+	cancel.cancelled = ret;
+	cancel.stops_avoided = avoided;
+	if (copy_to_user(arg, &cancel, sizeof(cancel)))
+		return -EFAULT;
+	return ret;
+}
+
+/*
+			ELEVATOR_IOC_EXPORT and ELEVATOR_IOC_IMPORT, an export writes the size back on success
+			and on ENOSPC so the caller can size its buffer.
+*/
+static long dev_state(struct elevator_state_xfer __user *arg, int import){
+	struct elevator_state_xfer xfer;
+	struct building *b;
+	long ret;
+
+	if (copy_from_user(&xfer, arg, sizeof(xfer)))
+		return -EFAULT;
+	b = building_get(xfer.building);
+	if (b == NULL)
+		return -ENODEV;
+	if (import)
+		ret = elevator_import(b, &xfer);
+	else
+		ret = elevator_export(b, &xfer);
+	building_put(b);
+
+	if (!import && (ret == 0 || ret == -ENOSPC) && put_user(xfer.size, &arg->size))
+		return -EFAULT;
+	return ret;
+}
+
+/*
+			Starting, stopping, resetting and moving a building's state affect every
+			user of the device, so they take CAP_SYS_ADMIN like writes to /proc/elevator.
+*/
+static int control_ioctl(unsigned int cmd){
+	switch (cmd){
+	case ELEVATOR_IOC_START:
+	case ELEVATOR_IOC_STOP:
+	case ELEVATOR_IOC_EXPORT:
+	case ELEVATOR_IOC_IMPORT:
+	case ELEVATOR_IOC_RESET:
+		return 1;
+	default:
+		return 0;
+	}
+}
+
+static long dev_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+	struct dev_file *df = file->private_data;
+	void __user *uarg = (void __user *)arg;
+
+	if (control_ioctl(cmd) && !capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	switch (cmd){
+	case ELEVATOR_IOC_START:
+		return dev_start(uarg);
+	case ELEVATOR_IOC_STOP:
+		return dev_stop(uarg);
+	case ELEVATOR_IOC_ISSUE:
+		return dev_issue(df, uarg);
+	case ELEVATOR_IOC_ISSUE_BATCH:
+		return dev_issue_batch(df, uarg);
+	case ELEVATOR_IOC_STATS:
+		return dev_stats(uarg);
+	case ELEVATOR_IOC_EVENTS:
+		return events_open(uarg);
+	case ELEVATOR_IOC_TICKET_WAIT:
+		return dev_ticket_wait(df, uarg);
+	case ELEVATOR_IOC_CANCEL:
+		return dev_cancel(df, uarg);
+	case ELEVATOR_IOC_EXPORT:
+		return dev_state(uarg, 0);
+	case ELEVATOR_IOC_IMPORT:
+		return dev_state(uarg, 1);
+	case ELEVATOR_IOC_RESET:
+		return dev_reset(uarg);
+	case ELEVATOR_IOC_SAMPLES:
+		return dev_samples(uarg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+#if LINUX_VERSION_CODE < KERNEL_VERSION(5, 5, 0) && defined(CONFIG_COMPAT)
+/*
+			For ioctls whose argument is a pointer or unused, converts it with compat_ptr().
+*/
+long compat_ptr_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+	if (!file->f_op->unlocked_ioctl)
+		return -ENOIOCTLCMD;
+	return file->f_op->unlocked_ioctl(file, cmd, (unsigned long)compat_ptr(arg));
+}
+#endif
+
+static int dev_open(struct inode *inode, struct file *file){
+	struct dev_file *df;
+
+	df = kzalloc(sizeof(struct dev_file), GFP_KERNEL);
+	if (df == NULL)
+		return -ENOMEM;
+	df->producer = new_producer_id();
+	mutex_init(&df->lock);
+	hash_init(df->tickets);
+	file->private_data = df;
+	return 0;
+}
+
+/*
+			Passengers still on their way keep their tickets until they are gone.
+*/
+static int dev_release(struct inode *inode, struct file *file){
+	struct dev_file *df = file->private_data;
+	struct hlist_node *next;
+	struct ticket *tk;
+	int bkt;
+
+	hash_for_each_safe(df->tickets, bkt, next, tk, node){
+		forget_ticket(df, tk);
+	}
+	kfree(df);
+	return 0;
+}
+
+static const struct file_operations dev_fops = {
+	.owner = THIS_MODULE,
+	.open = dev_open,
+	.release = dev_release,
+	.unlocked_ioctl = dev_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.llseek = noop_llseek,
+};
+
+/*
+			Open to everyone like /proc/elevator is readable by everyone, the control
+			ioctls check CAP_SYS_ADMIN themselves.
+*/
+static struct miscdevice elevator_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = ELEVATOR_DEV_NAME,
+	.fops = &dev_fops,
+	.mode = 0666,
+};
+
+int elevator_dev_init(void){
+	return misc_register(&elevator_dev);
+}
+
+void elevator_dev_exit(void){
+	misc_deregister(&elevator_dev);
+}
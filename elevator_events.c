@@ -0,0 +1,221 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/anon_inodes.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+
+#include "elevator.h"
+#include "elevator_uapi.h"
+
+/*
+			One reader of the events of a building, behind an anonymous file.
+			buf: ring of entries events, head is read by the listener, tail written by post_event
+			lost: dropped since the last event that was delivered
+			lost_total: dropped since the listener was created
+			Everything but wait is protected by the events_lock of the building.
+*/
+struct event_listener {
+	struct building *b;
+	struct list_head node;
+	struct elevator_event *buf;
+	u32 entries;
+	u32 head;
+	u32 tail;
+	u32 lost;
+	u64 lost_total;
+	wait_queue_head_t wait;
+};
+
+void init_events(struct building *b){
+	spin_lock_init(&b->events_lock);
+	INIT_LIST_HEAD(&b->listeners);
+}
+
+/*
+			Hand an event of building @b to every listener.
+			Called from the scheduler with the building locks held, costs one
+			list check when nobody listens.
+*/
+void post_event(struct building *b, u32 type, int floor, Passenger *p){
+	struct event_listener *l;
+	struct elevator_event *ev;
+	u64 now;
+
+	if (list_empty_careful(&b->listeners))
+		return;
+
+	now = ktime_get_ns();
+	spin_lock(&b->events_lock);
+	list_for_each_entry(l, &b->listeners, node){
+		if (l->tail - l->head == l->entries){
+			l->lost++;
+			l->lost_total++;
+			continue;
+		}
+		ev = &l->buf[l->tail & (l->entries - 1)];
+		ev->time_ns = now;
+		ev->type = type;
+		ev->lost = l->lost;
+		ev->floor = floor;
+		ev->dest = p ? p->destination : 0;
+		ev->passenger_type = p ? p->type : 0;
+		ev->status = b->elevator.status;
+		ev->ticket = p ? p->ticket : 0;
+		if (type == ELEVATOR_EV_BOARD)
+			ev->duration_ns = p->boarded - p->arrival;
+		else if (type == ELEVATOR_EV_ALIGHT)
+			ev->duration_ns = now - p->boarded;
+		else if (type == ELEVATOR_EV_CANCEL)
+			ev->duration_ns = now - p->arrival;
+		else
+			ev->duration_ns = 0;
+		l->lost = 0;
+		l->tail++;
+		wake_up_interruptible(&l->wait);
+	}
+	spin_unlock(&b->events_lock);
+}
+
+static int events_pending(struct event_listener *l){
+	int ret;
+
+	spin_lock(&l->b->events_lock);
+	ret = l->tail != l->head;
+	spin_unlock(&l->b->events_lock);
+	return ret;
+}
+
+static ssize_t events_read(struct file *file, char __user *buf, size_t count, loff_t *ppos){
+	struct event_listener *l = file->private_data;
+	struct elevator_event ev;
+	ssize_t done = 0;
+	int ret;
+
+	if (count < sizeof(ev))
+		return -EINVAL;
+
+	while (done + sizeof(ev) <= count){
+		spin_lock(&l->b->events_lock);
+		if (l->tail == l->head){
+			spin_unlock(&l->b->events_lock);
+			if (done)
+				break;
+			if (file->f_flags & O_NONBLOCK)
+				return -EAGAIN;
+			ret = wait_event_interruptible(l->wait, events_pending(l));
+			if (ret)
+				return ret;
+			continue;
+		}
+		ev = l->buf[l->head & (l->entries - 1)];
+		l->head++;
+		spin_unlock(&l->b->events_lock);
+
+		if (copy_to_user(buf + done, &ev, sizeof(ev)))
+			return done ? done : -EFAULT;
+		done += sizeof(ev);
+	}
+	return done;
+}
+
+static unsigned int events_poll(struct file *file, poll_table *wait){
+	struct event_listener *l = file->private_data;
+
+	poll_wait(file, &l->wait, wait);
+	return events_pending(l) ? POLLIN | POLLRDNORM : 0;
+}
+
+static long events_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+	struct event_listener *l = file->private_data;
+	u64 lost;
+
+	switch (cmd){
+	case ELEVATOR_EVENTS_LOST:
+		spin_lock(&l->b->events_lock);
+		lost = l->lost_total;
+		spin_unlock(&l->b->events_lock);
+		return put_user(lost, (u64 __user *)arg);
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int events_release(struct inode *inode, struct file *file){
+	struct event_listener *l = file->private_data;
+
+	spin_lock(&l->b->events_lock);
+	list_del(&l->node);
+	spin_unlock(&l->b->events_lock);
+	building_put(l->b);
+	kvfree(l->buf);
+	kfree(l);
+	return 0;
+}
+
+static const struct file_operations events_fops = {
+	.owner = THIS_MODULE,
+	.read = events_read,
+	.poll = events_poll,
+	.unlocked_ioctl = events_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.release = events_release,
+	.llseek = noop_llseek,
+};
+
+/*
+			ELEVATOR_IOC_EVENTS, attach a listener to a building.
+			Returns the new file descriptor, the listener keeps the building alive.
+*/
+long events_open(struct elevator_events_params __user *arg){
+	struct elevator_events_params params;
+	struct event_listener *l;
+	struct building *b;
+	int fd;
+
+	if (copy_from_user(&params, arg, sizeof(params)))
+		return -EFAULT;
+	if (params.entries == 0)
+		params.entries = ELEVATOR_EVENTS_DEFAULT;
+	if (!is_power_of_2(params.entries) || params.entries > ELEVATOR_EVENTS_MAX)
+		return -EINVAL;
+
+	b = building_get(params.building);
+	if (b == NULL)
+		return -ENODEV;
+	l = kzalloc(sizeof(struct event_listener), GFP_KERNEL);
+	if (l == NULL)
+		goto out_put;
+	l->buf = kvmalloc_array(params.entries, sizeof(struct elevator_event), GFP_KERNEL);
+	if (l->buf == NULL)
+		goto out_free;
+	l->b = b;
+	l->entries = params.entries;
+	init_waitqueue_head(&l->wait);
+
+	// on the list before the descriptor exists, events_release may run as soon as it does
+	spin_lock(&b->events_lock);
+	list_add_tail(&l->node, &b->listeners);
+	spin_unlock(&b->events_lock);
+	fd = anon_inode_getfd("[elevator_events]", &events_fops, l, O_RDONLY | O_CLOEXEC);
+	if (fd < 0){
+		spin_lock(&b->events_lock);
+		list_del(&l->node);
+		spin_unlock(&b->events_lock);
+		kvfree(l->buf);
+		kfree(l);
+		building_put(b);
+		return fd;
+	}
+	return fd;
+
+out_free:
+	kfree(l);
+out_put:
+	building_put(b);
+	return -ENOMEM;
+}
@@ -0,0 +1,89 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+
+#include "elevator.h"
+
+/*
+			Hold and wait times of the building mutexes by call site, always on.
+			An uncontended acquisition costs a trylock and two clock reads, a contended
+			one a third clock read. The counters of a lock are only written while it is
+			held, so the lock itself protects them.
+*/
+
+static void lock_acquired(struct lock_stats *ls, int site, u64 begin, int contended){
+	struct lock_site_stats *st = &ls->sites[site];
+	u64 now = ktime_get_ns();
+	u64 wait;
+
+	st->acquired += 1;
+	if (contended){
+		wait = now - begin;
+		st->contended += 1;
+		st->wait_ns += wait;
+		if (wait > st->wait_max_ns)
+			st->wait_max_ns = wait;
+	}
+	ls->held_since = now;
+	ls->site = site;
+}
+
+static void timed_lock(struct mutex *m, struct lock_stats *ls, int site){
+	u64 begin;
+
+	if (mutex_trylock(m)){
+		lock_acquired(ls, site, 0, 0);
+		return;
+	}
+	begin = ktime_get_ns();
+	mutex_lock(m);
+	lock_acquired(ls, site, begin, 1);
+}
+
+static int timed_lock_interruptible(struct mutex *m, struct lock_stats *ls, int site){
+	u64 begin;
+
+	if (mutex_trylock(m)){
+		lock_acquired(ls, site, 0, 0);
+		return 0;
+	}
+	begin = ktime_get_ns();
+	if (mutex_lock_interruptible(m))
+		return -EINTR;
+	lock_acquired(ls, site, begin, 1);
+	return 0;
+}
+
+static void timed_unlock(struct mutex *m, struct lock_stats *ls){
+	struct lock_site_stats *st = &ls->sites[ls->site];
+	u64 hold = ktime_get_ns() - ls->held_since;
+
+	st->hold_ns += hold;
+	if (hold > st->hold_max_ns)
+		st->hold_max_ns = hold;
+	mutex_unlock(m);
+}
+
+void floors_lock(struct building *b, int site){
+	timed_lock(&b->floors_l_mutex, &b->floors_lock_stats, site);
+}
+
+void floors_unlock(struct building *b){
+	timed_unlock(&b->floors_l_mutex, &b->floors_lock_stats);
+}
+
+void elevator_lock(struct building *b, int site){
+	timed_lock(&b->elevator_l_mutex, &b->elevator_lock_stats, site);
+}
+
+/*
+			elevator_lock() that gives up with -EINTR on a signal
+*/
+int elevator_lock_interruptible(struct building *b, int site){
+	return timed_lock_interruptible(&b->elevator_l_mutex, &b->elevator_lock_stats, site);
+}
+
+void elevator_unlock(struct building *b){
+	timed_unlock(&b->elevator_l_mutex, &b->elevator_lock_stats);
+}
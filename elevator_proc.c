@@ -3,584 +3,643 @@
 #include <linux/module.h>
 #include <linux/linkage.h>
 #include <linux/proc_fs.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/string.h>
 #include <linux/uaccess.h>
-#include <linux/delay.h> //sleep
 #include <linux/list.h>
 #include <linux/kthread.h>
-#include <linux/delay.h>
 #include <linux/sched.h>
 #include <linux/mutex.h>
+#include <linux/kref.h>
+#include <linux/rcupdate.h>
+#include <linux/cpumask.h>
+#include <linux/sched/types.h>
+#include <linux/workqueue.h>
+#include <linux/ktime.h>
+
+#include "elevator.h"
+#include "elevator_uapi.h"
 MODULE_LICENSE("GPL");
 MODULE_DESCRIPTION("Simple Elevator Kernel");
 
 
 #define ENTRY_NAME "elevator"
-#define ENTRY_SIZE 1024
+#define CONTROL_NAME "control"
+#define CONTROL_SIZE 256
+#define DEFAULT_NAME "default"
 #define PERMS 0644
 #define PARENT NULL
 
-// passenger types
-#define ADULT 1
-#define CHILD 2
-#define ROOM_SERVICE 3
-#define BELLHOP 4
+static struct file_operations fops;
+static struct file_operations control_fops;
+static struct proc_dir_entry *elevator_dir;
 
-// elevator capacity
-#define MAX_WEIGHT 30
-#define MAX_UNITS 10
+/*
+			Table of the running buildings, indexed by building id.
+			Lookups from the system calls only take the RCU read lock and a reference
+			on the building, buildings_mutex serializes create and destroy.
+*/
+static struct building __rcu *buildings[MAX_BUILDINGS];
+static DEFINE_MUTEX(buildings_mutex);
 
-// time constants
-#define MOVE_TIME 2
-#define LOAD_TIME 1
+/*
+			Default placement of the worker threads of new buildings,
+			change it per building at runtime through /proc/elevator/control.
+			worker_cpus: cpu list the workers may run on, empty for any cpu
+			worker_policy: normal, batch, idle, fifo or rr
+			worker_prio: nice value for normal and batch, rt priority 1-99 for fifo and rr
+*/
+static char worker_cpus[64] = "";
+static char worker_policy[8] = "normal";
+static int worker_prio = 0;
+module_param_string(worker_cpus, worker_cpus, sizeof(worker_cpus), 0444);
+MODULE_PARM_DESC(worker_cpus, "CPU list for elevator worker threads, empty for any");
+module_param_string(worker_policy, worker_policy, sizeof(worker_policy), 0444);
+MODULE_PARM_DESC(worker_policy, "Scheduling policy of elevator worker threads: normal, batch, idle, fifo, rr");
+module_param(worker_prio, int, 0444);
+MODULE_PARM_DESC(worker_prio, "Nice value (normal, batch) or rt priority (fifo, rr) of elevator worker threads");
 
-#define START_FLOOR 1
+/*
+			thread: every building has a worker thread that sleeps through each move
+			timer: the state machine of every building is advanced by delayed work
+				on the shared elevator workqueue (/sys/devices/virtual/workqueue/elevator
+				has its cpumask and nice value)
+*/
+static char exec_mode[8] = "thread";
+module_param_string(exec_mode, exec_mode, sizeof(exec_mode), 0644);
+MODULE_PARM_DESC(exec_mode, "How new buildings run their elevator: thread or timer");
 
-// elevator states
-#define OFFLINE 0
-#define IDLE 1
-#define LOADING 2
-// below are saved in twice in struct
-// when we switch state to loading we want to be able 
-// to resume in the same movement directions if there are more
-// passengers going that directions already on a queue
-#define DOWN 3
-#define UP 4
+struct workqueue_struct *elevator_wq;
 
+static const char *phase_names[NUM_PHASES] = {"IDLE", "MOVING", "DOORS", "LOADING", "HOLD"};
 
+static const struct {
+	const char *name;
+	int policy;
+} policies[] = {
+	{"normal", SCHED_NORMAL},
+	{"batch", SCHED_BATCH},
+	{"idle", SCHED_IDLE},
+	{"fifo", SCHED_FIFO},
+	{"rr", SCHED_RR},
+};
 
-static struct file_operations fops;
-static char *message;
-static int read_p;
-struct task_struct *elevator_thread;
-struct mutex floors_l_mutex;
-struct mutex elevator_l_mutex;
-/* 
+/*
 			System Calls functions listed below
 			they are external -> defined in sys_call.c
 			int start_elevator(void) :
-				Activates the elevator for service. 
-				From that point onward, the elevator exists and will begin to service requests. 
+				Activates the elevator for service.
+				From that point onward, the elevator exists and will begin to service requests.
 				return 1 if the elevator is already active
 				0 for a successful elevator start
 				-ERRORNUM if it could not initialize (e.g. -ENOMEM if it couldn’t allocate memory).
-			
+
 			int issue_request(int passenger_type, int start_floor, int destination_floor):
 				Creates a passenger of type @passenger_type at @start_floorthat wishes to go to @destination_floor
 				This function returns 1 if the request is not valid (one of the variables is out of range)
-				0 otherwise 
+				0 otherwise
 
-			int stop_elevator: 
-				Turn the elevator off, 
+			int stop_elevator:
+				Turn the elevator off,
 				Deliver people in the elevator, do not load more passengers.
-				set elevator status to OFFLINE 
+				set elevator status to OFFLINE
 
+			The calls above work on the default building, the *_id variants take
+			the building id as their first argument and return -ENODEV for an unknown id.
 
 */
+
 /*
-			elevator type represents the elevator object 
-			status: idle, offline, loading, up, down 
-			int w_load: weight
-			int unit_load: number of passengers 
-			int floor: floor number
-			int direction: UP/DOWN (defined as 4/3)
-			int next_stop: next floor intended to service
-			int shutdown: 1 or 0, if 1 start shutdown procedure, don't accept more passengers
+			Take a reference on building @id, NULL if there is no such building.
+*/
+struct building *building_get(int id){
+	struct building *b;
+
+	if (id < 0 || id >= MAX_BUILDINGS)
+		return NULL;
+
+	rcu_read_lock();
+	b = rcu_dereference(buildings[id]);
+	if (b != NULL && !kref_get_unless_zero(&b->ref))
+		b = NULL;
+	rcu_read_unlock();
+	return b;
+}
 
+/*
+			Called when the last reference is gone, the worker is already stopped.
 */
+static void building_release(struct kref *ref){
+	struct building *b = container_of(ref, struct building, ref);
+
+	// a system call may have kicked the elevator after it was destroyed
+	if (b->timer_mode)
+		cancel_delayed_work_sync(&b->step_work);
+	free_passengers(b);
+	free_cpumask_var(b->worker_cpus);
+	kfree(rcu_dereference_protected(b->cfg, 1));
+	kfree_rcu(b, rcu);
+}
 
-struct {
-	int status; 
-	int w_load; 
-	int unit_load; 
-	int floor;
-	int direction; 
-	int next_stop; 
-	int shutdown; 
-	int serviced;
-	int up_bound;
-	int low_bound;
-	int served_per_fl[10];
+void building_put(struct building *b){
+	kref_put(&b->ref, building_release);
+}
 
-	struct list_head p_list;
-} elevator;
+static int parse_policy(const char *name){
+	int i;
+	for (i = 0; i < ARRAY_SIZE(policies); ++i){
+		if (strcmp(policies[i].name, name) == 0)
+			return policies[i].policy;
+	}
+	return -EINVAL;
+}
 
+static const char *policy_name(int policy){
+	int i;
+	for (i = 0; i < ARRAY_SIZE(policies); ++i){
+		if (policies[i].policy == policy)
+			return policies[i].name;
+	}
+	return "unknown";
+}
 
+static int check_prio(int policy, int prio){
+	if (policy == SCHED_FIFO || policy == SCHED_RR)
+		return (prio >= 1 && prio < MAX_USER_RT_PRIO) ? 0 : -EINVAL;
+	if (policy == SCHED_IDLE)
+		return prio == 0 ? 0 : -EINVAL;
+	return (prio >= -20 && prio <= 19) ? 0 : -EINVAL;
+}
 
 /*
-			passenger type [ADULT or CHILD or ROOM_SERVICE or BELLHOP]
-			used to store passenger information after an elevator request
-			weight: 1, 2, 4, 6
-			units: 1,2
-			start: initial floor (1-10)
-			destination: drop off (make sure different then start and between 1-10)
-
+			Apply the placement of building @b to worker thread @t,
+			every worker a building starts has to go through here.
 */
-typedef struct passenger {
-	int weight;
-	int units; 
-	int start;
-	int destination;
-	int type;
-
-	struct list_head list;
-} Passenger;
-
+int building_place_worker(struct building *b, struct task_struct *t){
+	struct sched_param param = { .sched_priority = 0 };
+	int ret;
 
+	if (t == NULL)
+		return 0;
+	ret = set_cpus_allowed_ptr(t, b->worker_cpus);
+	if (ret)
+		return ret;
+	if (b->worker_policy == SCHED_FIFO || b->worker_policy == SCHED_RR)
+		param.sched_priority = b->worker_prio;
+	ret = sched_setscheduler_nocheck(t, b->worker_policy, &param);
+	if (ret)
+		return ret;
+	if (b->worker_policy == SCHED_NORMAL || b->worker_policy == SCHED_BATCH)
+		set_user_nice(t, b->worker_prio);
+	return 0;
+}
 
-/* 
-			Defining an array of the waiting lists for floors. 
+/*
+			Move the workers of building @b to @cpus, @policy and @prio.
+			Called with buildings_mutex held, on failure the old placement is kept.
 */
-
-struct list_head floors[10];
+static int building_set_placement(struct building *b, const struct cpumask *cpus, int policy, int prio){
+	cpumask_var_t old_cpus;
+	int old_policy = b->worker_policy;
+	int old_prio = b->worker_prio;
+	int ret;
+
+	if (!cpumask_intersects(cpus, cpu_online_mask) || check_prio(policy, prio))
+		return -EINVAL;
+	if (!alloc_cpumask_var(&old_cpus, GFP_KERNEL))
+		return -ENOMEM;
+	cpumask_copy(old_cpus, b->worker_cpus);
+
+	cpumask_copy(b->worker_cpus, cpus);
+	b->worker_policy = policy;
+	b->worker_prio = prio;
+	ret = building_place_worker(b, b->elevator_thread);
+	if (ret){
+		cpumask_copy(b->worker_cpus, old_cpus);
+		b->worker_policy = old_policy;
+		b->worker_prio = old_prio;
+		building_place_worker(b, b->elevator_thread);
+	}
+	free_cpumask_var(old_cpus);
+	return ret;
+}
 
 /*
-			init waiting lists in the array of floors.
+			Create a building called @name with its own elevator thread and /proc/elevator/@name
+			Returns the new building id or a negative error.
 */
-int init_floor_lists(void) {
-
+int building_create(const char *name){
+	struct building *b;
+	int id;
 	int i;
-	for (i = 0; i < 10; ++ i){
-		INIT_LIST_HEAD(&floors[i]);
+	int ret;
+
+	if (strcmp(exec_mode, "thread") != 0 && strcmp(exec_mode, "timer") != 0)
+		return -EINVAL;
+	if (name[0] == '\0' || strlen(name) >= BUILDING_NAME_LEN || strchr(name, '/') != NULL || strcmp(name, CONTROL_NAME) == 0)
+		return -EINVAL;
+
+	mutex_lock(&buildings_mutex);
+	id = -1;
+	for (i = 0; i < MAX_BUILDINGS; ++i){
+		b = rcu_dereference_protected(buildings[i], lockdep_is_held(&buildings_mutex));
+		if (b == NULL){
+			if (id == -1)
+				id = i;
+		}
+		else if (strcmp(b->name, name) == 0){
+			ret = -EEXIST;
+			goto out;
+		}
+	}
+	if (id == -1){
+		ret = -ENOSPC;
+		goto out;
 	}
 
-	return 0;
-}
-
+	b = kzalloc(sizeof(struct building), GFP_KERNEL);
+	if (b == NULL){
+		ret = -ENOMEM;
+		goto out;
+	}
+	b->id = id;
+	strcpy(b->name, name);
+	kref_init(&b->ref);
+	mutex_init(&b->floors_l_mutex);
+	mutex_init(&b->elevator_l_mutex);
+	init_waitqueue_head(&b->wait);
+	init_events(b);
+	init_floor_lists(b);
+	INIT_DELAYED_WORK(&b->step_work, elevator_step_work);
+	b->timer_mode = strcmp(exec_mode, "timer") == 0;
+	if (init_config(b)){
+		kfree(b);
+		ret = -ENOMEM;
+		goto out;
+	}
+	elevator_init(b);
 
+	if (!alloc_cpumask_var(&b->worker_cpus, GFP_KERNEL)){
+		kfree(rcu_dereference_protected(b->cfg, 1));
+		kfree(b);
+		ret = -ENOMEM;
+		goto out;
+	}
+	ret = 0;
+	if (worker_cpus[0] == '\0')
+		cpumask_copy(b->worker_cpus, cpu_possible_mask);
+	else
+		ret = cpulist_parse(worker_cpus, b->worker_cpus);
+	b->worker_policy = parse_policy(worker_policy);
+	b->worker_prio = worker_prio;
+	if (ret || b->worker_policy < 0 || check_prio(b->worker_policy, b->worker_prio)){
+		printk(KERN_WARNING "invalid worker placement %s %s %d\n", worker_cpus, worker_policy, worker_prio);
+		ret = -EINVAL;
+		goto out_free;
+	}
 
-/* 
-			Definining functions required for system calls.
-*/
+	b->proc = proc_create_data(name, PERMS, elevator_dir, &fops, b);
+	if (b->proc == NULL){
+		printk(KERN_WARNING "proc create %s\n", name);
+		ret = -ENOMEM;
+		goto out_free;
+	}
 
-long start_elevator(void);
-long issue_request(int, int, int);
-long stop_elevator(void);
+	if (b->timer_mode){
+		// parked until the first kick queues the step work
+		atomic_set(&b->parked, 1);
+		goto publish;
+	}
 
-/*
-			Function that initializes a global object elevator.
-			Triggered by a system call.
-*/
-extern long (*STUB_start_elevator)(void);
-long start_elevator(void){
-	int i;
-	if (elevator.status == IDLE || elevator.status == LOADING || elevator.status == UP || elevator.status == DOWN)
-		return 1;
-	else {
-		printk("Starting elevator\n");
-
-		elevator.status = IDLE;
-		elevator.w_load = 0;
-		elevator.unit_load = 0;
-		elevator.floor = 1; 
-		elevator.up_bound = -1;
-		elevator.low_bound = -1;
-		elevator.next_stop = -2;
-		elevator.shutdown = -1;
-		elevator.serviced = 0;
-		
-		for (i = 0; i < 10; ++i){
-			elevator.served_per_fl[i] = 0;
-		}
-		// init the list of passengers in the elevator 
-		INIT_LIST_HEAD(&elevator.p_list);
-		// create an array of linked lists 
-		init_floor_lists();
-		return 0;
+	// create a thread for the elevator of this building and place it before it runs
+	b->elevator_thread = kthread_create(run_elevator, b, "elevator/%d", id);
+	if (IS_ERR(b->elevator_thread)) {
+		printk(KERN_WARNING "error spawning thread");
+		ret = PTR_ERR(b->elevator_thread);
+		goto out_proc;
+	}
+	ret = building_place_worker(b, b->elevator_thread);
+	if (ret){
+		printk(KERN_WARNING "error placing thread %d\n", ret);
+		kthread_stop(b->elevator_thread);
+		goto out_proc;
 	}
-	
+	wake_up_process(b->elevator_thread);
+
+publish:
+
+	rcu_assign_pointer(buildings[id], b);
+	printk(KERN_NOTICE "/proc/%s/%s create\n", ENTRY_NAME, name);
+	mutex_unlock(&buildings_mutex);
+	return id;
+
+out_proc:
+	proc_remove(b->proc);
+out_free:
+	free_cpumask_var(b->worker_cpus);
+	kfree(rcu_dereference_protected(b->cfg, 1));
+	kfree(b);
+out:
+	mutex_unlock(&buildings_mutex);
+	return ret;
 }
 
 /*
-			Function that places a passenger on a waiting list.
-			Triggered by a system call.
+			Unpublish building @b, stop its thread and drop the table reference.
+			Called with buildings_mutex held.
 */
-extern long (*STUB_issue_request)(int, int, int);
-long issue_request(int passenger_type, int start_floor, int destination_floor){
-	if ( (passenger_type > 4) || (passenger_type < 1) )
-		return 1;
-	else if ( (start_floor < 1) || (start_floor > 10) )
-		return 1;
-	else if ( (destination_floor < 1) || (destination_floor > 10) )
-		return 1;
-	else {
-		Passenger *p;
-		int weight;
-		int units;
-		switch (passenger_type) {
-			case ADULT:
-				weight = 2;
-				units = 1;
-				break;
-			case CHILD:
-				weight = 1;
-				units = 1;
-				break;
-			case ROOM_SERVICE:
-				weight = 4;
-				units = 2;
-				break;
-			case BELLHOP:
-				weight= 6;
-				units = 2;
-				break;
-			default:
-				return 1;
-		}
-		p = kmalloc(sizeof(Passenger) * 1, __GFP_RECLAIM);
-		if (p == NULL)
-			return -ENOMEM;
+static void building_destroy(struct building *b){
+	int elevator_ret;
+	u64 begin = ktime_get_ns();
 
-		p->weight = weight;
-		p->units = units;
-		p->start = start_floor;
-		p->destination = destination_floor;
-		p->type = passenger_type; 
+	RCU_INIT_POINTER(buildings[b->id], NULL);
 
-		mutex_lock_interruptible(&floors_l_mutex);
-		list_add_tail(&p->list, &floors[start_floor - 1]); /* insert at back of list */
-		mutex_unlock(&floors_l_mutex);
+	if (b->timer_mode){
+		cancel_delayed_work_sync(&b->step_work);
 	}
-
-	return 0;
+	else {
+		// the worker sleeps interruptibly, this does not wait for the current move
+		elevator_ret = kthread_stop(b->elevator_thread);
+		if (elevator_ret != -EINTR)
+			printk(KERN_INFO "Elevator thread %d has stopped\n", b->id);
+	}
+	// free everyone now rather than when the last reference goes
+	elevator_lock(b, LOCK_SITE_TEARDOWN);
+	floors_lock(b, LOCK_SITE_TEARDOWN);
+	free_passengers(b);
+	floors_unlock(b);
+	elevator_unlock(b);
+	proc_remove(b->proc);
+	printk(KERN_NOTICE "Removing /proc/%s/%s, teardown took %llu us\n", ENTRY_NAME, b->name,
+		(ktime_get_ns() - begin) / NSEC_PER_USEC);
+	building_put(b);
 }
 
 /*
-			Function that turns off the elevator.
-			Triggered by a system call
+			Find the building called @name, called with buildings_mutex held.
 */
-extern long (*STUB_stop_elevator)(void);
-long stop_elevator(void){
+static struct building *building_find(const char *name){
+	struct building *b;
+	int i;
 
-	mutex_lock_interruptible(&elevator_l_mutex);
-	
-	if (elevator.status == OFFLINE || elevator.shutdown == 1){
-		mutex_unlock(&elevator_l_mutex);
-		return 1;
+	for (i = 0; i < MAX_BUILDINGS; ++i){
+		b = rcu_dereference_protected(buildings[i], lockdep_is_held(&buildings_mutex));
+		if (b != NULL && strcmp(b->name, name) == 0)
+			return b;
 	}
-	elevator.shutdown = 1;
-	mutex_unlock(&elevator_l_mutex);
-	return 0;
-	
+	return NULL;
 }
 
-/* 
-			Place people from a floor floor_no in the elevator,if there is enough room.
-			If elevator was empty, update the direction.
-			Update bounds, next_stop, weight and unit load. 
+/*
+			Destroy the building called @name, system calls still holding
+			a reference finish on it before it is freed.
 */
-void load_elevator(int floor_no) {
-	struct list_head *temp;
-	struct list_head *dummy;
-	Passenger *a;
-
-	//printk("Made it to the load function\n");
-
-	/* move items to a temporary list to illustrate movement */
-	//list_for_each_prev_safe(temp, dummy, &animals.list) { /* backwards */
-	list_for_each_safe(temp, dummy, &floors[floor_no]) { /* forwards */
-		a = list_entry(temp, Passenger, list);
-		printk("The MAX_WEIGHT is: %d, the w_load is: %d, and the passenger weight is %d\n", MAX_WEIGHT, elevator.w_load, a->weight);
-		printk("The MAX_UNITS is: %d, the unit_load is: %d, and the passenger unit is %d\n", MAX_UNITS, elevator.unit_load, a->units);
-		if ( (elevator.w_load + a->weight <= MAX_WEIGHT) && (elevator.unit_load + a->units <= MAX_UNITS) ) {
-			printk("Case 1");
-			// elevator changes direction only when empty
-			// first person that enters sets the direction
-			if (list_empty(&elevator.p_list)){ 
-				printk("Case 2");
-				if (a -> destination > elevator.floor){
-					printk("Case 3");
-					elevator.direction = UP;
-					elevator.up_bound = a -> destination;
-					elevator.next_stop = a -> destination;
-				}	
-				else{
-					printk("Case 4");
-					elevator.direction = DOWN;
-					elevator.low_bound = a -> destination;
-					elevator.next_stop = a -> destination;
-				}
-				//Add case where a passenger wants to stay on the same floor
-				printk("Case 5");
-				list_move_tail(temp, &elevator.p_list); /* move to back of list */
-				elevator.w_load += a->weight;
-				elevator.unit_load += a->units;
-				// add floor serviced here 
-			}
-			else if (elevator.direction == UP && a->destination > elevator.floor) {
-				printk("Case 6");
-				list_move_tail(temp, &elevator.p_list); /* move to back of list */
-				if (a->destination > elevator.up_bound){
-					elevator.up_bound = a -> destination;
-					printk("Case 7");
-				}
-				else if (a -> destination < elevator.next_stop){
-					elevator.next_stop = a -> destination;
-					printk("Case 8");
-				}
-				elevator.w_load += a->weight;
-				elevator.unit_load += a->units;
-			}
-			else if (elevator.direction == DOWN && a->destination < elevator.floor) {
-				printk("Case 9");
-				list_move_tail(temp, &elevator.p_list); /* move to back of list */
-				if (a->destination < elevator.low_bound){
-					elevator.low_bound = a -> destination;
-					printk("Case 10");
-				}
-				else if (a -> destination > elevator.next_stop){
-					elevator.next_stop = a -> destination;
-					printk("Case 11");
-				}
-				printk("Case 12");
-				elevator.w_load += a->weight;
-				elevator.unit_load += a->units;
-			}	
-		}
+int building_destroy_by_name(const char *name){
+	struct building *b;
+	int ret = -ENOENT;
+
+	mutex_lock(&buildings_mutex);
+	b = building_find(name);
+	if (b != NULL){
+		building_destroy(b);
+		ret = 0;
 	}
+	mutex_unlock(&buildings_mutex);
+	return ret;
 }
 
-/* 
-			Unload people from the elevator if floor_no equals their destination 
+/*
+			Handle "affinity <name> <cpulist>" and "sched <name> <policy> <prio>"
 */
-void unload_elevator(int floor_no){
-	struct list_head move_list;
-	struct list_head *temp;
-	struct list_head *dummy;
-	int i;
-	Passenger *a;
+static int building_control_placement(char *cmd){
+	char *op = strsep(&cmd, " ");
+	char *name = strsep(&cmd, " ");
+	struct building *b;
+	cpumask_var_t cpus;
+	char policy[8];
+	int prio;
+	int ret;
+
+	if (name == NULL || cmd == NULL)
+		return -EINVAL;
+	if (!alloc_cpumask_var(&cpus, GFP_KERNEL))
+		return -ENOMEM;
 
-	INIT_LIST_HEAD(&move_list);
+	mutex_lock(&buildings_mutex);
+	b = building_find(name);
+	if (b == NULL){
+		ret = -ENOENT;
+	}
+	else if (b->timer_mode){
+		// timer mode workers are the elevator workqueue, placed through its sysfs directory
+		ret = -EOPNOTSUPP;
+	}
+	else if (strcmp(op, "affinity") == 0){
+		ret = cpulist_parse(strim(cmd), cpus);
+		if (ret == 0)
+			ret = building_set_placement(b, cpus, b->worker_policy, b->worker_prio);
+	}
+	else if (sscanf(cmd, "%7s %d", policy, &prio) == 2 && parse_policy(policy) >= 0){
+		cpumask_copy(cpus, b->worker_cpus);
+		ret = building_set_placement(b, cpus, parse_policy(policy), prio);
+	}
+	else {
+		ret = -EINVAL;
+	}
+	mutex_unlock(&buildings_mutex);
 
-	/* move items to a temporary list to illustrate movement */
-	//list_for_each_prev_safe(temp, dummy, &animals.list) { /* backwards */
-	list_for_each_safe(temp, dummy, &elevator.p_list) { /* forwards */
-		a = list_entry(temp, Passenger, list);
+	free_cpumask_var(cpus);
+	return ret;
+}
 
-		if (a->destination == floor_no) {
-			list_move_tail(temp, &move_list); /* move to back of list */
-			elevator.w_load -= a->weight;
-			elevator.unit_load -= a->units;
-			elevator.serviced += 1;
-			elevator.served_per_fl[(a->start)-1] += 1;
-		}
-	}	
+/*
+			Parse "v0,v1,v2,v3" into the per type table @t.
+*/
+static int parse_types(const char *val, int *t){
+	return sscanf(val, "%d,%d,%d,%d", &t[0], &t[1], &t[2], &t[3]) == NUM_TYPES ? 0 : -EINVAL;
+}
 
-	/* print stats of list to syslog, entry version just as example (not needed here) */
-	i = 0;
-	list_for_each_entry(a, &move_list, list) { /* forwards */
-		/* can access a directly e.g. a->id */
-		i++;
+/*
+			Handle "tune <name> <key>=<value> ..." with the keys move_ms, load_ms, max_weight,
+			max_units, and weight and units taking one value per passenger type, comma separated.
+			Keys left out keep their value, either every change applies or none does.
+*/
+static int building_control_tune(char *cmd){
+	char *name;
+	char *arg;
+	char *key;
+	struct elevator_config cfg;
+	struct building *b;
+	int ret = 0;
+
+	strsep(&cmd, " ");
+	name = strsep(&cmd, " ");
+	if (name == NULL || cmd == NULL)
+		return -EINVAL;
+
+	mutex_lock(&buildings_mutex);
+	b = building_find(name);
+	if (b == NULL){
+		mutex_unlock(&buildings_mutex);
+		return -ENOENT;
 	}
-	printk(KERN_NOTICE "%d people left the elevator", i);
-
-	/* free up memory allocation of Animals */
-	//list_for_each_prev_safe(temp, dummy, &move_list) { /* backwards */
-	list_for_each_safe(temp, dummy, &move_list) { /* forwards */
-		a = list_entry(temp, Passenger, list);
-		list_del(temp);	/* removes entry from list */
-		kfree(a);
+	elevator_lock(b, LOCK_SITE_CONFIG);
+	cfg = *building_cfg(b);
+	elevator_unlock(b);
+
+	while (ret == 0 && (arg = strsep(&cmd, " ")) != NULL){
+		if (*arg == '\0')
+			continue;
+		key = strsep(&arg, "=");
+		if (arg == NULL)
+			ret = -EINVAL;
+		else if (strcmp(key, "move_ms") == 0)
+			ret = kstrtoint(arg, 10, &cfg.move_ms);
+		else if (strcmp(key, "load_ms") == 0)
+			ret = kstrtoint(arg, 10, &cfg.load_ms);
+		else if (strcmp(key, "max_weight") == 0)
+			ret = kstrtoint(arg, 10, &cfg.max_weight);
+		else if (strcmp(key, "max_units") == 0)
+			ret = kstrtoint(arg, 10, &cfg.max_units);
+		else if (strcmp(key, "weight") == 0)
+			ret = parse_types(arg, cfg.weight);
+		else if (strcmp(key, "units") == 0)
+			ret = parse_types(arg, cfg.units);
+		else
+			ret = -EINVAL;
 	}
+	if (ret == 0)
+		ret = elevator_set_config(b, &cfg);
+	mutex_unlock(&buildings_mutex);
+	return ret;
 }
 
 /*
-			CHeck if any passenger reached his/her destination
+			Handle "reset <name>"
 */
-int should_unload(int f){
-	struct list_head *temp;
-	Passenger *p;
-	// read only access, no need for for_each_safe
-	list_for_each(temp, &elevator.p_list){
-		p = list_entry(temp, Passenger, list);
-		
-		if (f == p->destination){
-			return 1; // return true if needs to unload
-		}
-	}
-
-	return 0; // return false if no one is getting out
+static int building_control_reset(const char *name){
+	struct building *b;
+	int ret = -ENOENT;
+
+	mutex_lock(&buildings_mutex);
+	b = building_find(name);
+	if (b != NULL)
+		ret = elevator_reset_counters(b);
+	mutex_unlock(&buildings_mutex);
+	return ret;
 }
 
-/* 
-			Find the closest non epmty floor or set elevator to idle and return -1 if all floors are empty 
+/*
+			Definining functions required for system calls.
 */
-int empty_find_next_stop(void){
-	int closest = 100; // to make sure it get updated on the first check
-	int i;
 
-	if (elevator.shutdown == 1)
-		return -1;
+long start_elevator(void);
+long issue_request(int, int, int);
+long stop_elevator(void);
+long start_elevator_id(int);
+long issue_request_id(int, int, int, int);
+long stop_elevator_id(int);
+
+extern long (*STUB_start_elevator_id)(int);
+long start_elevator_id(int id){
+	struct building *b = building_get(id);
+	long ret;
+
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_start(b);
+	building_put(b);
+	return ret;
+}
 
-	for (i = 1; i < 11; ++i){
-		if (abs(elevator.floor - i) < abs(elevator.floor - closest) && !list_empty(&floors[i-1])){
-			closest = i;
-		}
-	}
-	// check if there was anyone waiting, if not set to idle
-	if ( closest != 100 ){ 
-		elevator.next_stop = closest;
-		if (elevator.next_stop > elevator.floor){
-			elevator.up_bound = closest; // the highest level with a passeneger on it
-			elevator.direction = UP;
-			elevator.status = UP;
-		}	
-		else{
-			elevator.low_bound = closest; // the lowest level with a passeneger on it
-			elevator.direction = DOWN;
-			elevator.status = DOWN;
-		}
-		return closest;
-	}
+extern long (*STUB_issue_request_id)(int, int, int, int);
+long issue_request_id(int id, int passenger_type, int start_floor, int destination_floor){
+	struct building *b = building_get(id);
+	long ret;
+
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_issue(b, passenger_type, start_floor, destination_floor);
+	building_put(b);
+	return ret;
+}
 
-	elevator.status = IDLE;
-	elevator.next_stop = -1;
-	elevator.low_bound = -1;
-	elevator.up_bound = -1;
+extern long (*STUB_stop_elevator_id)(int);
+long stop_elevator_id(int id){
+	struct building *b = building_get(id);
+	long ret;
 
-	return -1;
-	
+	if (b == NULL)
+		return -ENODEV;
+	ret = elevator_stop(b);
+	building_put(b);
+	return ret;
 }
 
-/* 			
-			check, and let them do it, if anyone wants to get out on the floor above/below
-			check, and let them do it, if anyone wants to get in on the floor above/below
-			set floor to floor +/- 1
-			return direction or -1 if empty
-*/
-void move_one(int direction){
-	
-	mutex_unlock(&elevator_l_mutex);
-	mutex_unlock(&floors_l_mutex);
-	ssleep(MOVE_TIME);	
-	mutex_lock_interruptible(&floors_l_mutex);	
-	mutex_lock_interruptible(&elevator_l_mutex);
-	if (direction == UP)
-		elevator.floor += 1;
-	else
-		elevator.floor -= 1;
-
-	if (should_unload(elevator.floor)){ 
-		elevator.status = LOADING;
-		mutex_unlock(&elevator_l_mutex);
-		mutex_unlock(&floors_l_mutex);
-		ssleep(LOAD_TIME);
-		mutex_lock_interruptible(&floors_l_mutex);	
-		mutex_lock_interruptible(&elevator_l_mutex);
-		//ssleep(LOAD_TIME);
-		unload_elevator(elevator.floor);
-		if(!list_empty(&floors[elevator.floor - 1]) && elevator.shutdown != 1){
-			load_elevator(elevator.floor - 1);
-		}
-	}
-	else if (!list_empty(&floors[elevator.floor]) && elevator.shutdown != 1){
-		elevator.status = LOADING;
-		mutex_unlock(&elevator_l_mutex);
-		mutex_unlock(&floors_l_mutex);
-		ssleep(LOAD_TIME);
-		mutex_lock_interruptible(&floors_l_mutex);	
-		mutex_lock_interruptible(&elevator_l_mutex);
-		//ssleep(LOAD_TIME);
-		load_elevator(elevator.floor -1);
-	}
-
-	// Restore Status after loading 
-	// If no loading happened should not cause change
-	// If elevator empty and no requests, status will be changed after this function returns 
-	elevator.status = elevator.direction;
-}
-
-/*  
-			Main algorithm, modified SCAN, Works like a "classic" elevator
-			If for instance direction is UP it goes on the highest floor requested,
-			and drops off/picks up passengers, going the same direction, on its way.
-			Changes direction only when empty.
-			Many optimizations possible
-*/
+extern long (*STUB_start_elevator)(void);
+long start_elevator(void){
+	return start_elevator_id(DEFAULT_BUILDING);
+}
 
-int run_elevator(void* params){
-	
-	while (!kthread_should_stop())
-	{
-		mutex_lock_interruptible(&elevator_l_mutex);
-		if (elevator.status != OFFLINE)
-		{			
-
-			mutex_lock_interruptible(&floors_l_mutex);	
-			if ( list_empty(&elevator.p_list) ){
-				
-				int ret = empty_find_next_stop();
-				if (elevator.shutdown == 1){
-					elevator.status = OFFLINE;
-				}
-				else if (ret == elevator.floor && elevator.shutdown != 1){
-					elevator.status = LOADING;
-					mutex_unlock(&elevator_l_mutex);
-					mutex_unlock(&floors_l_mutex);
-					ssleep(LOAD_TIME);
-					mutex_lock_interruptible(&floors_l_mutex);	
-					mutex_lock_interruptible(&elevator_l_mutex);
-					load_elevator(elevator.floor - 1);
-				}
-				else if (ret != -1){
-					move_one(elevator.direction);
-				}
-				
-			}			
-			else
-			{
-				move_one(elevator.direction);
-				
-				if (list_empty(&elevator.p_list))
-					empty_find_next_stop();
-					
-			}
-			mutex_unlock(&floors_l_mutex);
-		}
-		mutex_unlock(&elevator_l_mutex);
+extern long (*STUB_issue_request)(int, int, int);
+long issue_request(int passenger_type, int start_floor, int destination_floor){
+	return issue_request_id(DEFAULT_BUILDING, passenger_type, start_floor, destination_floor);
+}
 
-	}
-	return 0;	
-} 
+extern long (*STUB_stop_elevator)(void);
+long stop_elevator(void){
+	return stop_elevator_id(DEFAULT_BUILDING);
+}
+
+static const char *lock_site_names[NUM_LOCK_SITES] = {"step", "queue", "cancel", "stop", "report", "stats", "state", "config", "teardown", "reset", "start"};
+static const char *status_names[NUM_STATUS] = {"Offline", "Idle", "Loading", "Down", "Up"};
+static const char *class_names[NUM_CLASSES] = {"BEST_EFFORT", "SLA", "URGENT"};
+static const char *traffic_names[NUM_TRAFFIC] = {"INTERFLOOR", "UP_PEAK", "DOWN_PEAK"};
 
 /*
-			Get the total weight of wait list on @floor_no
+			One line per call site that took the mutex counted by @ls.
 */
-int floor_w_load(int floor_no){
-	struct list_head *temp;
-	Passenger *p;
-	int weight = 0;
-	// read only access, no need for for_each_safe
-	list_for_each(temp, &floors[floor_no]){
-		p = list_entry(temp, Passenger, list);
-		weight += p-> weight;
+static void print_lock_stats(struct seq_file *m, const char *lock, struct lock_stats *ls){
+	struct lock_site_stats *st;
+	int i;
+
+	for (i = 0; i < NUM_LOCK_SITES; ++i){
+		st = &ls->sites[i];
+		if (st->acquired == 0)
+			continue;
+		seq_printf(m, "%s %s: Acquired: %llu Contended: %llu Avg Wait: %llu ns Max Wait: %llu ns Avg Hold: %llu ns Max Hold: %llu ns\n",
+			lock, lock_site_names[i], st->acquired, st->contended,
+			st->contended ? st->wait_ns / st->contended : 0, st->wait_max_ns,
+			st->hold_ns / st->acquired, st->hold_max_ns);
 	}
-	return weight;
 }
 
 /*
-			Get the total units of wait list on @floor_no
+			Rate @r over every window, per second or with @per_min per minute, two decimals.
 */
-int floor_u_load(int floor_no){
-	struct list_head *temp;
-	Passenger *p;
-	int units = 0;
-	// read only access, no need for for_each_safe
-	list_for_each(temp, &floors[floor_no]){
-		p = list_entry(temp, Passenger, list);
-		units += p-> units;
+static void print_rate(struct seq_file *m, struct rate *r, int per_min){
+	u64 v;
+	int w;
+
+	for (w = 0; w < RATE_WINDOWS; ++w){
+		v = ((u64)r->avg[w] * (per_min ? 6000 : 100)) >> RATE_SHIFT;
+		seq_printf(m, " %llu.%02llu", v / 100, v % 100);
 	}
-	return units;
 }
 
 /*
 			create a report from elevator and the building
 */
-void print_stats(char* message){
+void print_stats(struct seq_file *m, struct building *b){
+	struct elevator_config *cfg = building_cfg(b);
+	struct step_stats *st;
+	struct queue_stats *qs;
+	u64 now = ktime_get_ns();
+	u64 avg;
 	int i;
-	char buffer[512];
 	char status_string[12];
-	switch(elevator.status){
+	switch(b->elevator.status){
 		case OFFLINE:
 			strcpy(status_string, "OFFLINE");
 			break;
@@ -597,86 +656,221 @@ void print_stats(char* message){
 			strcpy(status_string, "IDLE");
 			break;
 	}
-	sprintf(message, "\nElevator Report:\n");
-	sprintf(buffer, "Elevator Status: %s\nElevator Floor: %d\nElevator Next Floor: %d\nWeight Load: %d\nUnit Load: %d\n", status_string, elevator.floor, elevator.next_stop, elevator.w_load, elevator.unit_load);
-	strcat(message, buffer);
-	sprintf(buffer, "\nBuilding Report:\n");
-	strcat(message, buffer);
+	seq_printf(m, "\nElevator Report (%s, id %d):\n", b->name, b->id);
+	seq_printf(m, "Elevator Status: %s\nElevator Floor: %d\nElevator Next Floor: %d\nWeight Load: %d\nUnit Load: %d\n", status_string, b->elevator.floor, b->elevator.next_stop, b->elevator.w_load, b->elevator.unit_load);
+	seq_printf(m, "\nBuilding Report:\n");
 	for (i = 0; i < 10; ++i){
-		sprintf(buffer, "Floor %d:\nPeople Serviced: %d\nCurrent Weight Load: %d\nCurrent Unit Load: %d\n", i+1, elevator.served_per_fl[i], floor_w_load(i), floor_u_load(i));
-		strcat(message, buffer);
+		seq_printf(m, "Floor %d:\nPeople Serviced: %d\nCurrent Weight Load: %d\nCurrent Unit Load: %d\n", i+1, b->elevator.served_per_fl[i], floor_w_load(b, i), floor_u_load(b, i));
+	}
+	seq_printf(m, "\nPriority Report:\n");
+	for (i = NUM_CLASSES - 1; i >= 0; --i){
+		seq_printf(m, "Class %s: Boarded: %d Deadline Misses: %d\n", class_names[i], b->elevator.boarded_per_class[i], b->elevator.deadline_miss[i]);
 	}
+	seq_printf(m, "\nWait Report (aging %s, weights %d/%d):\nMax Wait: %llu s\nP99 Wait: %d s\n",
+		aging_wait_weight ? "on" : "off", aging_dist_weight, aging_wait_weight,
+		b->elevator.longest_wait / NSEC_PER_SEC, wait_percentile(b, 99));
+	seq_printf(m, "Cancelled: %d\nStops Avoided: %d\n", b->elevator.cancelled, b->elevator.stops_avoided);
+	seq_printf(m, "\nShutdown Report:\nLast Shutdown: %llu ms\nPredicted Drain: %d ms\nDrain Floors: %d\nPlanned Drain Floors: %d\nDropped Waiting: %d\n",
+		b->elevator.last_shutdown_ns / NSEC_PER_MSEC, b->elevator.drain_plan_ms, b->elevator.drain_floors,
+		b->elevator.drain_plan_floors, b->elevator.dropped);
+	seq_printf(m, "\nDwell Report (max %d ms):\nHolds: %d\nHold Time: %llu ms\nBoarded While Held: %d\nDepartures: %d\nLoad Factor: %d%%\n",
+		dwell_max_ms, b->elevator.holds, b->elevator.hold_ns / NSEC_PER_MSEC, b->elevator.held_boarded,
+		b->elevator.departures, load_factor(b));
+	seq_printf(m, "\nMotion Report:\n");
+	for (i = 0; i < NUM_STATUS; ++i){
+		seq_printf(m, "Time %s: %llu ms\n", status_names[i], status_time(b, i, now) / NSEC_PER_MSEC);
+	}
+	seq_printf(m, "Floors Loaded: %d\nFloors Empty: %d\nStops With Boarding: %d\nStops Without Boarding: %d\nUnit Load Factor: %d%%\nWeight Load Factor: %d%%\n",
+		b->elevator.floors_loaded, b->elevator.floors_empty, b->elevator.stops_boarded,
+		b->elevator.stops_unboarded, load_factor(b), weight_factor(b));
+	rates_advance(b, now);
+	seq_printf(m, "\nRate Report (1 s, 10 s, 60 s):\nAccepted/s:");
+	print_rate(m, &b->accepted, 0);
+	seq_printf(m, "\nDelivered/min:");
+	print_rate(m, &b->delivered, 1);
+	seq_printf(m, "\n");
+	for (i = 0; i < NUM_FLOORS; ++i){
+		seq_printf(m, "Floor %d: Accepted/s:", i + 1);
+		print_rate(m, &b->floor_accepted[i], 0);
+		seq_printf(m, " Delivered/min:");
+		print_rate(m, &b->floor_delivered[i], 1);
+		seq_printf(m, "\n");
+	}
+	sample_floors(b, now);
+	seq_printf(m, "\nQueue Report (every %llu ms, %llu samples):\n", b->sample_ns / NSEC_PER_MSEC, b->samples);
+	for (i = 0; i < NUM_FLOORS && b->samples; ++i){
+		qs = &b->queue_stats[i];
+		avg = div64_u64(qs->sum_queue * 100, b->samples);
+		seq_printf(m, "Floor %d: Queue Min/Avg/Max: %u/%llu.%02llu/%u Oldest Wait Min/Avg/Max: %u/%llu/%u ms\n", i + 1,
+			qs->min_queue, avg / 100, avg % 100, qs->max_queue,
+			qs->min_age_ms, div64_u64(qs->sum_age_ms, b->samples), qs->max_age_ms);
+	}
+	seq_printf(m, "\nTraffic Report (detection %s):\nMode: %s\nSwitches: %d\nFrom Lobby: %d%%\nTo Lobby: %d%%\n",
+		traffic_detect ? "on" : "off", traffic_names[b->traffic_mode], b->traffic_switches,
+		lobby_share(b, 0), lobby_share(b, 1));
+	seq_printf(m, "\nConfig Report:\nMove Time: %d ms\nLoad Time: %d ms\nMax Weight: %d\nMax Units: %d\n",
+		cfg->move_ms, cfg->load_ms, cfg->max_weight, cfg->max_units);
+	seq_printf(m, "Weights: %d,%d,%d,%d\nUnits: %d,%d,%d,%d\n", cfg->weight[0], cfg->weight[1], cfg->weight[2],
+		cfg->weight[3], cfg->units[0], cfg->units[1], cfg->units[2], cfg->units[3]);
+	if (b->elevator_thread != NULL){
+		seq_printf(m, "\nWorker Report:\nPid: %d\nCurrent CPU: %d\nAllowed CPUs: %*pbl\nPolicy: %s\nPriority: %d\nContext Switches: %lu\n",
+			task_pid_nr(b->elevator_thread), task_cpu(b->elevator_thread), cpumask_pr_args(b->worker_cpus),
+			policy_name(b->worker_policy), b->worker_prio,
+			b->elevator_thread->nvcsw + b->elevator_thread->nivcsw);
+	}
+	seq_printf(m, "\nState Machine Report:\nMode: %s\nPhase: %s\n",
+		b->timer_mode ? "timer" : "thread", phase_names[b->elevator.phase]);
+	for (i = 0; i < NUM_PHASES; ++i){
+		st = &b->step_stats[i];
+		seq_printf(m, "Leaving %s: Transitions: %llu Avg: %llu ns Max: %llu ns\n", phase_names[i],
+			st->count, st->count ? st->total_ns / st->count : 0, st->max_ns);
+	}
+	seq_printf(m, "\nLock Report:\n");
+	print_lock_stats(m, "elevator_l_mutex", &b->elevator_lock_stats);
+	print_lock_stats(m, "floors_l_mutex", &b->floors_lock_stats);
+}
+
+int elevator_proc_show(struct seq_file *m, void *v) {
+	struct building *b = m->private;
+
+	elevator_lock(b, LOCK_SITE_REPORT);
+	floors_lock(b, LOCK_SITE_REPORT);
+	print_stats(m, b);
+	floors_unlock(b);
+	elevator_unlock(b);
+	return 0;
 }
 
 int elevator_proc_open(struct inode *sp_inode, struct file *sp_file) {
 	printk(KERN_INFO "proc called open\n");
-	
-	read_p = 1;
-	message = kmalloc(sizeof(char) * ENTRY_SIZE, __GFP_RECLAIM | __GFP_IO | __GFP_FS);
-	if (message == NULL) {
-		printk(KERN_WARNING "elevator_proc_open");
-		return -ENOMEM;
-	}
+	return single_open(sp_file, elevator_proc_show, PDE_DATA(sp_inode));
+}
+
+/*
+			/proc/elevator/control lists the buildings,
+			writing "create <name>" or "destroy <name>" adds or removes one,
+			"affinity <name> <cpulist>" and "sched <name> <policy> <prio>" move its workers,
+			"tune <name> <key>=<value> ..." changes its timings and capacity,
+			"reset <name>" zeroes its counters.
+*/
+int control_proc_show(struct seq_file *m, void *v) {
+	struct building *b;
+	int i;
 
-	mutex_lock_interruptible(&elevator_l_mutex);
-	mutex_lock_interruptible(&floors_l_mutex);
-	print_stats(message);
-	mutex_unlock(&floors_l_mutex);
-	mutex_unlock(&elevator_l_mutex);
-	
+	mutex_lock(&buildings_mutex);
+	for (i = 0; i < MAX_BUILDINGS; ++i){
+		b = rcu_dereference_protected(buildings[i], lockdep_is_held(&buildings_mutex));
+		if (b != NULL)
+			seq_printf(m, "%d %s\n", b->id, b->name);
+	}
+	mutex_unlock(&buildings_mutex);
 	return 0;
 }
 
-ssize_t elevator_proc_read(struct file *sp_file, char __user *buf, size_t size, loff_t *offset) {
-	int len = strlen(message);
-	
-	read_p = !read_p;
-	if (read_p)
-		return 0;
-		
-	printk(KERN_INFO "proc called read\n");
-	copy_to_user(buf, message, len);
-	return len;
+int control_proc_open(struct inode *sp_inode, struct file *sp_file) {
+	return single_open(sp_file, control_proc_show, NULL);
 }
 
-int elevator_proc_release(struct inode *sp_inode, struct file *sp_file) {
-	printk(KERN_NOTICE "proc called release\n");
-	kfree(message);
-	return 0;
+ssize_t control_proc_write(struct file *sp_file, const char __user *buf, size_t size, loff_t *offset) {
+	char cmd[CONTROL_SIZE];
+	char *name;
+	int ret;
+
+	if (size >= CONTROL_SIZE)
+		return -EINVAL;
+	if (copy_from_user(cmd, buf, size))
+		return -EFAULT;
+	cmd[size] = '\0';
+	name = strim(cmd);
+
+	if (strncmp(name, "create ", 7) == 0)
+		ret = building_create(strim(name + 7));
+	else if (strncmp(name, "destroy ", 8) == 0)
+		ret = building_destroy_by_name(strim(name + 8));
+	else if (strncmp(name, "affinity ", 9) == 0 || strncmp(name, "sched ", 6) == 0)
+		ret = building_control_placement(name);
+	else if (strncmp(name, "tune ", 5) == 0)
+		ret = building_control_tune(name);
+	else if (strncmp(name, "reset ", 6) == 0)
+		ret = building_control_reset(strim(name + 6));
+	else
+		ret = -EINVAL;
+
+	return ret < 0 ? ret : size;
 }
+
 /*
 		Initialize the module
 */
 static int elevator_init(void) {
+	int ret;
+
 	printk(KERN_NOTICE "/proc/%s create\n",ENTRY_NAME);
+	fops.owner = THIS_MODULE;
 	fops.open = elevator_proc_open;
-	fops.read = elevator_proc_read;
-	fops.release = elevator_proc_release;
-	
-	// assign functions to function pointers for sys calls
-	STUB_start_elevator = start_elevator;
-	STUB_issue_request = issue_request;
-	STUB_stop_elevator = stop_elevator;
+	fops.read = seq_read;
+	fops.llseek = seq_lseek;
+	fops.release = single_release;
+
+	control_fops.owner = THIS_MODULE;
+	control_fops.open = control_proc_open;
+	control_fops.read = seq_read;
+	control_fops.write = control_proc_write;
+	control_fops.llseek = seq_lseek;
+	control_fops.release = single_release;
+
+	elevator_wq = alloc_workqueue("elevator", WQ_UNBOUND | WQ_SYSFS, 0);
+	if (elevator_wq == NULL)
+		return -ENOMEM;
 
-	if (!proc_create(ENTRY_NAME, PERMS, NULL, &fops)) {
+	elevator_dir = proc_mkdir(ENTRY_NAME, PARENT);
+	if (elevator_dir == NULL) {
 		printk(KERN_WARNING "proc create\n");
-		remove_proc_entry(ENTRY_NAME, NULL);
+		destroy_workqueue(elevator_wq);
+		return -ENOMEM;
+	}
+	if (!proc_create(CONTROL_NAME, PERMS, elevator_dir, &control_fops)) {
+		printk(KERN_WARNING "proc create\n");
+		remove_proc_subtree(ENTRY_NAME, PARENT);
+		destroy_workqueue(elevator_wq);
 		return -ENOMEM;
 	}
 
-	//initialize the locks
-	mutex_init(&floors_l_mutex);
-	mutex_init(&elevator_l_mutex);
+	ret = building_create(DEFAULT_NAME);
+	if (ret < 0) {
+		remove_proc_subtree(ENTRY_NAME, PARENT);
+		destroy_workqueue(elevator_wq);
+		return ret;
+	}
 
-	// create a thread for our elevator
-	elevator_thread = kthread_run(run_elevator, NULL, "elevator_thread");
-	if (IS_ERR(elevator_thread)) {
-		printk(KERN_WARNING "error spawning thread");
-		remove_proc_entry(ENTRY_NAME, NULL);
-		return PTR_ERR(elevator_thread);
+	ret = elevator_ring_init();
+	if (ret < 0) {
+		printk(KERN_WARNING "/dev/%s register\n", ELEVATOR_RING_NAME);
+		building_destroy_by_name(DEFAULT_NAME);
+		remove_proc_subtree(ENTRY_NAME, PARENT);
+		rcu_barrier();
+		destroy_workqueue(elevator_wq);
+		return ret;
 	}
-	start_elevator();
-	stop_elevator();
+
+	ret = elevator_dev_init();
+	if (ret < 0) {
+		printk(KERN_WARNING "/dev/%s register\n", ELEVATOR_DEV_NAME);
+		elevator_ring_exit();
+		building_destroy_by_name(DEFAULT_NAME);
+		remove_proc_subtree(ENTRY_NAME, PARENT);
+		rcu_barrier();
+		destroy_workqueue(elevator_wq);
+		return ret;
+	}
+
+	// assign functions to function pointers for sys calls
+	STUB_start_elevator = start_elevator;
+	STUB_issue_request = issue_request;
+	STUB_stop_elevator = stop_elevator;
+	STUB_start_elevator_id = start_elevator_id;
+	STUB_issue_request_id = issue_request_id;
+	STUB_stop_elevator_id = stop_elevator_id;
 	return 0;
 }
 module_init(elevator_init);
@@ -685,17 +879,32 @@ module_init(elevator_init);
 			Uninstall the module
 */
 static void elevator_exit(void) {
-	int elevator_ret;
+	struct building *b;
+	int i;
 
 	// set sys call function pointers to NULLs
 	STUB_start_elevator = NULL;
 	STUB_issue_request = NULL;
 	STUB_stop_elevator = NULL;
+	STUB_start_elevator_id = NULL;
+	STUB_issue_request_id = NULL;
+	STUB_stop_elevator_id = NULL;
+
+	elevator_dev_exit();
+	elevator_ring_exit();
+
+	mutex_lock(&buildings_mutex);
+	for (i = 0; i < MAX_BUILDINGS; ++i){
+		b = rcu_dereference_protected(buildings[i], lockdep_is_held(&buildings_mutex));
+		if (b != NULL)
+			building_destroy(b);
+	}
+	mutex_unlock(&buildings_mutex);
 
-	elevator_ret = kthread_stop(elevator_thread);
-	if (elevator_ret != -EINTR)
-		printk("Elevator thread has stopped\n");
-	remove_proc_entry(ENTRY_NAME, NULL);
+	remove_proc_subtree(ENTRY_NAME, PARENT);
 	printk(KERN_NOTICE "Removing /proc/%s\n", ENTRY_NAME);
+	// wait for the kfree_rcu callbacks before the module text goes away
+	rcu_barrier();
+	destroy_workqueue(elevator_wq);
 }
 module_exit(elevator_exit);
@@ -0,0 +1,299 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/fs.h>
+#include <linux/miscdevice.h>
+#include <linux/mm.h>
+#include <linux/vmalloc.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
+#include <linux/kref.h>
+
+#include "elevator.h"
+#include "elevator_uapi.h"
+
+/*
+			Shared memory submission ring, one per open file of /dev/elevator_ring.
+			Requests are read from the mapped submission ring in batches by sq_work,
+			so a producer needs one ELEVATOR_RING_ENTER per batch instead of one
+			system call per request. Layout and protocol are in elevator_uapi.h.
+
+			building: building id the requests go to
+			producer: stamped on every request, see ELEVATOR_CANCEL_PRODUCER
+			mem, mem_size: vmalloc_user() area mapped by user space
+			hdr, sqes, cqes: views into mem
+			sq_head, cq_tail, cq_overflow: the module's own copies, user space can
+				scribble over the header so it is only ever written from these
+			cq_lock: completions are posted by sq_work and by the elevator step
+			setup_lock: serializes ELEVATOR_RING_SETUP against the doorbell
+			ref: held by the file and by every passenger submitted through the ring
+*/
+struct elevator_ring {
+	int building;
+	u64 producer;
+	void *mem;
+	size_t mem_size;
+	struct elevator_ring_header *hdr;
+	struct elevator_sqe *sqes;
+	struct elevator_cqe *cqes;
+	u32 sq_entries;
+	u32 cq_entries;
+
+	u32 sq_head;
+	u32 cq_tail;
+	u32 cq_overflow;
+
+	spinlock_t cq_lock;
+	wait_queue_head_t cq_wait;
+	struct mutex setup_lock;
+	struct work_struct sq_work;
+	struct kref ref;
+};
+
+static void ring_release(struct kref *ref){
+	struct elevator_ring *r = container_of(ref, struct elevator_ring, ref);
+
+	vfree(r->mem);
+	kfree(r);
+}
+
+void ring_put(struct elevator_ring *r){
+	kref_put(&r->ref, ring_release);
+}
+
+/*
+			Post a completion for @user_tag, dropped and counted if the ring is full.
+*/
+void ring_complete(struct elevator_ring *r, u64 user_tag, u32 event, s32 res){
+	struct elevator_cqe *cqe;
+
+	spin_lock(&r->cq_lock);
+	if (r->cq_tail - READ_ONCE(r->hdr->cq_head) >= r->cq_entries){
+		r->cq_overflow++;
+		WRITE_ONCE(r->hdr->cq_overflow, r->cq_overflow);
+	}
+	else {
+		cqe = &r->cqes[r->cq_tail & (r->cq_entries - 1)];
+		cqe->user_tag = user_tag;
+		cqe->event = event;
+		cqe->res = res;
+		r->cq_tail++;
+		smp_store_release(&r->hdr->cq_tail, r->cq_tail);
+	}
+	spin_unlock(&r->cq_lock);
+
+	if (wq_has_sleeper(&r->cq_wait))
+		wake_up_interruptible(&r->cq_wait);
+}
+
+/*
+			Consume everything published in the submission ring.
+			Entries are copied out before they are checked, user space may rewrite them
+			at any time. Accepted passengers are queued as one batch.
+*/
+static void ring_sq_work(struct work_struct *work){
+	struct elevator_ring *r = container_of(work, struct elevator_ring, sq_work);
+	struct elevator_sqe sqe;
+	struct list_head batch;
+	struct building *b;
+	Passenger *p;
+	u32 tail;
+	u32 n;
+	long ret;
+
+	tail = smp_load_acquire(&r->hdr->sq_tail);
+	n = tail - r->sq_head;
+	if (n == 0)
+		return;
+	// a producer that ran past the ring loses what it overwrote, take one ring worth
+	if (n > r->sq_entries)
+		n = r->sq_entries;
+
+	INIT_LIST_HEAD(&batch);
+	b = building_get(r->building);
+	while (n--){
+		memcpy(&sqe, &r->sqes[r->sq_head & (r->sq_entries - 1)], sizeof(sqe));
+		r->sq_head++;
+
+		if (b == NULL)
+			ret = -ENODEV;
+		else if (sqe.flags != 0)
+			ret = 1;
+		else
+			ret = make_passenger(b, sqe.type, sqe.start, sqe.dest, &p);
+		if (ret){
+			ring_complete(r, sqe.user_tag, ELEVATOR_CQE_REJECTED, ret);
+			continue;
+		}
+
+		kref_get(&r->ref);
+		p->producer = r->producer;
+		p->ring = r;
+		p->user_tag = sqe.user_tag;
+		list_add_tail(&p->list, &batch);
+		ring_complete(r, sqe.user_tag, ELEVATOR_CQE_ACCEPTED, 0);
+	}
+	smp_store_release(&r->hdr->sq_head, r->sq_head);
+
+	if (b != NULL){
+		elevator_queue_batch(b, &batch);
+		building_put(b);
+	}
+	// the submission ring has room again
+	if (wq_has_sleeper(&r->cq_wait))
+		wake_up_interruptible(&r->cq_wait);
+}
+
+static int ring_setup(struct elevator_ring *r, struct elevator_ring_params __user *uparams){
+	struct elevator_ring_params params;
+	size_t size;
+
+	if (copy_from_user(&params, uparams, sizeof(params)))
+		return -EFAULT;
+	if (params.cq_entries == 0)
+		params.cq_entries = 2 * params.sq_entries;
+	if (params.building >= MAX_BUILDINGS)
+		return -EINVAL;
+	if (!is_power_of_2(params.sq_entries) || params.sq_entries > ELEVATOR_RING_MAX_ENTRIES)
+		return -EINVAL;
+	if (!is_power_of_2(params.cq_entries) || params.cq_entries > 2 * ELEVATOR_RING_MAX_ENTRIES)
+		return -EINVAL;
+
+	params.sq_off = sizeof(struct elevator_ring_header);
+	params.cq_off = params.sq_off + params.sq_entries * sizeof(struct elevator_sqe);
+	size = PAGE_ALIGN(params.cq_off + params.cq_entries * sizeof(struct elevator_cqe));
+	params.mmap_size = size;
+
+	mutex_lock(&r->setup_lock);
+	if (r->mem != NULL){
+		mutex_unlock(&r->setup_lock);
+		return -EBUSY;
+	}
+	r->mem = vmalloc_user(size);
+	if (r->mem == NULL){
+		mutex_unlock(&r->setup_lock);
+		return -ENOMEM;
+	}
+	r->mem_size = size;
+	r->building = params.building;
+	r->sq_entries = params.sq_entries;
+	r->cq_entries = params.cq_entries;
+	r->hdr = r->mem;
+	r->sqes = r->mem + params.sq_off;
+	r->cqes = r->mem + params.cq_off;
+	mutex_unlock(&r->setup_lock);
+
+	if (copy_to_user(uparams, &params, sizeof(params)))
+		return -EFAULT;
+	return 0;
+}
+
+static long ring_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+	struct elevator_ring *r = file->private_data;
+	int ret = 0;
+
+	switch (cmd){
+	case ELEVATOR_RING_SETUP:
+		return ring_setup(r, (struct elevator_ring_params __user *)arg);
+	case ELEVATOR_RING_ENTER:
+		// doorbell, doorbells rung while sq_work is pending fold into one batch
+		mutex_lock(&r->setup_lock);
+		if (r->mem == NULL)
+			ret = -EINVAL;
+		else
+			queue_work(elevator_wq, &r->sq_work);
+		mutex_unlock(&r->setup_lock);
+		return ret;
+	default:
+		return -ENOTTY;
+	}
+}
+
+static int ring_mmap(struct file *file, struct vm_area_struct *vma){
+	struct elevator_ring *r = file->private_data;
+	int ret;
+
+	mutex_lock(&r->setup_lock);
+	if (r->mem == NULL || vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start > r->mem_size)
+		ret = -EINVAL;
+	else
+		ret = remap_vmalloc_range(vma, r->mem, 0);
+	mutex_unlock(&r->setup_lock);
+	return ret;
+}
+
+static unsigned int ring_poll(struct file *file, poll_table *wait){
+	struct elevator_ring *r = file->private_data;
+	unsigned int mask = 0;
+
+	poll_wait(file, &r->cq_wait, wait);
+	mutex_lock(&r->setup_lock);
+	if (r->mem != NULL){
+		if (smp_load_acquire(&r->hdr->cq_tail) != READ_ONCE(r->hdr->cq_head))
+			mask |= POLLIN | POLLRDNORM;
+		if (READ_ONCE(r->hdr->sq_tail) - READ_ONCE(r->hdr->sq_head) < r->sq_entries)
+			mask |= POLLOUT | POLLWRNORM;
+	}
+	mutex_unlock(&r->setup_lock);
+	return mask;
+}
+
+static int ring_open(struct inode *inode, struct file *file){
+	struct elevator_ring *r;
+
+	r = kzalloc(sizeof(struct elevator_ring), GFP_KERNEL);
+	if (r == NULL)
+		return -ENOMEM;
+	spin_lock_init(&r->cq_lock);
+	init_waitqueue_head(&r->cq_wait);
+	mutex_init(&r->setup_lock);
+	INIT_WORK(&r->sq_work, ring_sq_work);
+	kref_init(&r->ref);
+	r->producer = new_producer_id();
+	file->private_data = r;
+	return 0;
+}
+
+/*
+			Passengers still in a building keep the ring alive and
+			post their deliveries to it until they are gone.
+*/
+static int ring_file_release(struct inode *inode, struct file *file){
+	struct elevator_ring *r = file->private_data;
+
+	cancel_work_sync(&r->sq_work);
+	ring_put(r);
+	return 0;
+}
+
+static const struct file_operations ring_fops = {
+	.owner = THIS_MODULE,
+	.open = ring_open,
+	.release = ring_file_release,
+	.unlocked_ioctl = ring_ioctl,
+	.compat_ioctl = compat_ptr_ioctl,
+	.mmap = ring_mmap,
+	.poll = ring_poll,
+	.llseek = noop_llseek,
+};
+
+/*
+			The ring only issues requests, which ELEVATOR_IOC_ISSUE allows everyone too.
+*/
+static struct miscdevice ring_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = ELEVATOR_RING_NAME,
+	.fops = &ring_fops,
+	.mode = 0666,
+};
+
+int elevator_ring_init(void){
+	return misc_register(&ring_dev);
+}
+
+void elevator_ring_exit(void){
+	misc_deregister(&ring_dev);
+}
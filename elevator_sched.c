@@ -0,0 +1,1621 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/delay.h> //sleep
+#include <linux/list.h>
+#include <linux/kthread.h>
+#include <linux/sched.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/wait.h>
+#include <linux/workqueue.h>
+#include <linux/atomic.h>
+#include <linux/math64.h>
+
+#include "elevator.h"
+#include "elevator_uapi.h"
+
+/*
+			Per passenger type scheduling parameters, indexed by type - 1.
+			prio_class: CLASS_BEST_EFFORT, CLASS_SLA or CLASS_URGENT
+			max_wait: maximum time in seconds a passenger should wait to board, 0 for no deadline
+*/
+static int prio_class[4] = {CLASS_BEST_EFFORT, CLASS_BEST_EFFORT, CLASS_URGENT, CLASS_SLA};
+static int max_wait[4] = {0, 0, 30, 60};
+module_param_array(prio_class, int, NULL, 0644);
+MODULE_PARM_DESC(prio_class, "Priority class per passenger type (0 best effort, 1 sla, 2 urgent)");
+module_param_array(max_wait, int, NULL, 0644);
+MODULE_PARM_DESC(max_wait, "Maximum wait in seconds per passenger type, 0 for no deadline");
+
+/*
+			Aging weights for picking the next floor of an empty elevator.
+			score = aging_dist_weight * distance - aging_wait_weight * oldest wait in seconds,
+			the floor with the lowest score wins. aging_wait_weight = 0 means closest floor only.
+*/
+int aging_dist_weight = 4;
+int aging_wait_weight = 1;
+module_param(aging_dist_weight, int, 0644);
+MODULE_PARM_DESC(aging_dist_weight, "Next stop score weight per floor of distance");
+module_param(aging_wait_weight, int, 0644);
+MODULE_PARM_DESC(aging_wait_weight, "Next stop score weight per second the oldest passenger waited, 0 disables aging");
+
+/*
+			Adaptive dwell. After loading, the doors stay open in HOLD_SLICE_MS steps while the car
+			has room and the measured arrival rate of this floor makes a request likely enough to
+			be worth the delay to everyone else, see should_hold(). dwell_max_ms scaled by the
+			free units caps the hold, a fuller car waits less. 0 disables holding.
+*/
+int dwell_max_ms = 5000;
+module_param(dwell_max_ms, int, 0644);
+MODULE_PARM_DESC(dwell_max_ms, "Longest time in ms the doors are held open for more passengers, 0 disables");
+
+/*
+			Traffic pattern detection. Recent requests are counted with exponential decay
+			(window of about 1 << OD_DECAY_SHIFT requests) and the share starting or ending on
+			START_FLOOR picks the pattern. A pattern is entered above TRAFFIC_ENTER_PCT and left
+			below TRAFFIC_EXIT_PCT, and never before TRAFFIC_MIN_REQUESTS requests since the last
+			switch, so the mode does not flap on mixed traffic.
+			Each pattern biases the best effort next stop score, picks where an idle car parks
+			and which way an empty car boards first, see traffic_params.
+*/
+int traffic_detect = 1;
+module_param(traffic_detect, int, 0644);
+MODULE_PARM_DESC(traffic_detect, "Detect up-peak, down-peak and interfloor traffic and adapt the next stop, parking floor and boarding to it, 0 disables");
+
+/*
+			Interval of the queue samples of every floor, taken up when a building is created
+			or its counters are reset so the samples of one run are evenly spaced.
+*/
+int sample_ms = 1000;
+module_param(sample_ms, int, 0644);
+MODULE_PARM_DESC(sample_ms, "Interval in ms between samples of the queue length and oldest wait of every floor");
+
+#define OD_ONE 1024
+#define OD_DECAY_SHIFT 6
+#define TRAFFIC_ENTER_PCT 60
+#define TRAFFIC_EXIT_PCT 45
+#define TRAFFIC_MIN_REQUESTS 32
+
+/*
+			lobby_bonus: score bonus of START_FLOOR
+			height_bonus: score bonus per floor above START_FLOOR
+			park_floor: floor an empty idle car goes to, 0 to stay where it is
+			direction: way the peak flows, 0 for none. An empty car boards passengers going
+				that way first, and passing floors a car picks up only those going its own
+				way, see collecting() and picks_up()
+*/
+static const struct {
+	int lobby_bonus;
+	int height_bonus;
+	int park_floor;
+	int direction;
+} traffic_params[NUM_TRAFFIC] = {
+	[TRAFFIC_INTERFLOOR] = {0, 0, 0, 0},
+	// everyone starts in the lobby, be there when they arrive
+	[TRAFFIC_UP_PEAK] = {8, 0, START_FLOOR, UP},
+	// everyone heads down, collect from the top so the car fills on the way
+	[TRAFFIC_DOWN_PEAK] = {0, 2, NUM_FLOORS, DOWN},
+};
+
+// passenger sizes by type - 1, ADULT, CHILD, ROOM_SERVICE, BELLHOP
+static const int default_weight[NUM_TYPES] = {2, 1, 4, 6};
+static const int default_units[NUM_TYPES] = {1, 1, 2, 2};
+
+// bounds of a tuned config, see config_valid()
+#define CONFIG_TIME_MAX_MS 60000
+#define CONFIG_SIZE_MAX 1000
+
+/*
+			Give building @b the default config, before it is published.
+*/
+int init_config(struct building *b){
+	struct elevator_config *cfg;
+	int t;
+
+	cfg = kzalloc(sizeof(struct elevator_config), GFP_KERNEL);
+	if (cfg == NULL)
+		return -ENOMEM;
+	cfg->move_ms = MOVE_TIME * MSEC_PER_SEC;
+	cfg->load_ms = LOAD_TIME * MSEC_PER_SEC;
+	cfg->max_weight = MAX_WEIGHT;
+	cfg->max_units = MAX_UNITS;
+	for (t = 0; t < NUM_TYPES; ++t){
+		cfg->weight[t] = default_weight[t];
+		cfg->units[t] = default_units[t];
+	}
+	RCU_INIT_POINTER(b->cfg, cfg);
+	return 0;
+}
+
+/*
+			Times within 1 ms to a minute, sizes within 1 to CONFIG_SIZE_MAX,
+			and every passenger type has to fit in the empty car or it would wait forever.
+*/
+static int config_valid(const struct elevator_config *cfg){
+	int t;
+
+	if (cfg->move_ms < 1 || cfg->move_ms > CONFIG_TIME_MAX_MS || cfg->load_ms < 1 || cfg->load_ms > CONFIG_TIME_MAX_MS)
+		return 0;
+	if (cfg->max_weight < 1 || cfg->max_weight > CONFIG_SIZE_MAX || cfg->max_units < 1 || cfg->max_units > CONFIG_SIZE_MAX)
+		return 0;
+	for (t = 0; t < NUM_TYPES; ++t){
+		if (cfg->weight[t] < 1 || cfg->weight[t] > cfg->max_weight || cfg->units[t] < 1 || cfg->units[t] > cfg->max_units)
+			return 0;
+	}
+	return 1;
+}
+
+/*
+			Replace the config of building @b with a copy of @cfg.
+			Taking both mutexes waits for the step in progress, so every step runs with one
+			config from start to end. Passengers keep the size they were created with,
+			a smaller capacity only stops boarding until the car is light enough.
+*/
+long elevator_set_config(struct building *b, const struct elevator_config *cfg){
+	struct elevator_config *new, *old;
+
+	if (!config_valid(cfg))
+		return -EINVAL;
+	new = kmemdup(cfg, sizeof(struct elevator_config), GFP_KERNEL);
+	if (new == NULL)
+		return -ENOMEM;
+
+	elevator_lock(b, LOCK_SITE_CONFIG);
+	floors_lock(b, LOCK_SITE_CONFIG);
+	old = building_cfg(b);
+	rcu_assign_pointer(b->cfg, new);
+	floors_unlock(b);
+	elevator_unlock(b);
+	kfree_rcu(old, rcu);
+
+	printk(KERN_INFO "elevator %s: move %d ms, load %d ms, capacity %d/%d\n", b->name,
+		new->move_ms, new->load_ms, new->max_weight, new->max_units);
+	return 0;
+}
+
+/*
+			init waiting lists in the array of floors, their aggregates and the ticket index.
+			Only once per building, passengers may wait while the elevator is offline.
+*/
+void init_floor_lists(struct building *b) {
+
+	int i, c;
+	for (i = 0; i < 10; ++ i){
+		for (c = 0; c < NUM_CLASSES; ++c)
+			INIT_LIST_HEAD(&b->floors[i][c]);
+		b->floor_count[i] = 0;
+		b->floor_weight[i] = 0;
+		b->floor_units[i] = 0;
+		b->last_arrival[i] = 0;
+		b->arrival_gap[i] = 0;
+	}
+	hash_init(b->waiting);
+	b->rate_tick = ktime_get_ns();
+	clear_samples(b, b->rate_tick);
+}
+
+/*
+			Free everyone still waiting on a floor or riding the elevator.
+*/
+void free_passengers(struct building *b) {
+	Passenger *p, *next;
+	int i, c;
+
+	for (i = 0; i < 10; ++i){
+		for (c = 0; c < NUM_CLASSES; ++c){
+			list_for_each_entry_safe(p, next, &b->floors[i][c], list){
+				unqueue_passenger(b, p);
+				release_passenger(p, RELEASE_DROPPED);
+			}
+		}
+	}
+	list_for_each_entry_safe(p, next, &b->elevator.p_list, list){
+		list_del(&p->list);
+		release_passenger(p, RELEASE_DROPPED);
+	}
+}
+
+/*
+			Free a passenger that is off every list,
+			@how tells a submission ring or ticket whether it got out on its destination floor
+			(RELEASE_DELIVERED), was cancelled while waiting (RELEASE_CANCELLED) or was dropped
+			(RELEASE_DROPPED), every accepted ring request ends with one of those completions.
+*/
+void release_passenger(Passenger *p, int how){
+	if (p->tk != NULL){
+		if (how == RELEASE_DELIVERED)
+			ticket_update(p->tk, ELEVATOR_TICKET_DELIVERED, p->boarded - p->arrival, ktime_get_ns() - p->boarded);
+		else if (how == RELEASE_CANCELLED)
+			ticket_update(p->tk, ELEVATOR_TICKET_CANCELLED, ktime_get_ns() - p->arrival, 0);
+		else
+			ticket_update(p->tk, ELEVATOR_TICKET_DROPPED, 0, 0);
+		ticket_put(p->tk);
+	}
+	if (p->ring != NULL){
+		if (how == RELEASE_DELIVERED)
+			ring_complete(p->ring, p->user_tag, ELEVATOR_CQE_DELIVERED, 0);
+		else if (how == RELEASE_CANCELLED)
+			ring_complete(p->ring, p->user_tag, ELEVATOR_CQE_CANCELLED, 0);
+		else
+			ring_complete(p->ring, p->user_tag, ELEVATOR_CQE_DROPPED, 0);
+		ring_put(p->ring);
+	}
+	kfree(p);
+}
+
+/*
+			Check if nobody is waiting on @floor_no (0 based)
+*/
+int floor_empty(struct building *b, int floor_no){
+	return b->floor_count[floor_no] == 0;
+}
+
+/*
+			Update the moving average of the time between requests on @floor_no (0 based), weight 1/8.
+*/
+static void note_arrival(struct building *b, int floor_no, u64 now){
+	u64 gap;
+
+	if (b->last_arrival[floor_no] != 0 && now > b->last_arrival[floor_no]){
+		gap = now - b->last_arrival[floor_no];
+		if (b->arrival_gap[floor_no] == 0)
+			b->arrival_gap[floor_no] = gap;
+		else
+			b->arrival_gap[floor_no] = (b->arrival_gap[floor_no] * 7 + gap) / 8;
+	}
+	b->last_arrival[floor_no] = now;
+}
+
+/*
+			Smoothed rates, like the load average: every whole second the count of that second
+			is folded into one moving average per window. Seconds nobody looked at are caught
+			up on the next count or read, so an idle building decays without a timer.
+			rate_decay: RATE_ONE * exp(-1 / window) for the 1, 10 and 60 s windows
+*/
+static const u32 rate_decay[RATE_WINDOWS] = {753, 1853, 2014};
+
+// @x to the power @n, both fixed point RATE_ONE
+static u64 rate_power(u64 x, u64 n){
+	u64 result = RATE_ONE;
+
+	while (n){
+		if (n & 1)
+			result = (result * x) >> RATE_SHIFT;
+		n >>= 1;
+		x = (x * x) >> RATE_SHIFT;
+	}
+	return result;
+}
+
+static void rate_tick(struct rate *r, u64 n){
+	u64 avg;
+	int w;
+
+	for (w = 0; w < RATE_WINDOWS; ++w){
+		avg = ((u64)r->avg[w] * rate_decay[w] + (u64)r->pending * RATE_ONE * (RATE_ONE - rate_decay[w])) >> RATE_SHIFT;
+		if (n > 1)
+			avg = (avg * rate_power(rate_decay[w], n - 1)) >> RATE_SHIFT;
+		r->avg[w] = avg;
+	}
+	r->pending = 0;
+}
+
+static void clear_rate(struct rate *r){
+	memset(r, 0, sizeof(*r));
+}
+
+/*
+			Fold the seconds elapsed up to @now into the rates of building @b,
+			called with floors_l_mutex held before counting or reading them.
+*/
+void rates_advance(struct building *b, u64 now){
+	u64 n;
+	int i;
+
+	if (now < b->rate_tick + NSEC_PER_SEC)
+		return;
+	n = div64_u64(now - b->rate_tick, NSEC_PER_SEC);
+	rate_tick(&b->accepted, n);
+	rate_tick(&b->delivered, n);
+	for (i = 0; i < NUM_FLOORS; ++i){
+		rate_tick(&b->floor_accepted[i], n);
+		rate_tick(&b->floor_delivered[i], n);
+	}
+	b->rate_tick += n * NSEC_PER_SEC;
+}
+
+/*
+			Restart the queue samples of building @b at @now, with the current sample_ms.
+*/
+void clear_samples(struct building *b, u64 now){
+	b->sample_ns = (u64)max(sample_ms, 1) * NSEC_PER_MSEC;
+	b->sample_next = now + b->sample_ns;
+	b->samples = 0;
+	memset(b->sample_ring, 0, sizeof(b->sample_ring));
+	memset(b->queue_stats, 0, sizeof(b->queue_stats));
+}
+
+/*
+			Take the samples of every floor due up to @now, called with floors_l_mutex held
+			before a waiting list changes and before the samples are read. Nothing changed
+			since the last due sample, so the ones missed are exact: the queue stayed the same
+			and its oldest passenger aged by one interval per sample. With k samples at once
+			the ages run from age to age + (k - 1) * interval, their sum is closed form.
+*/
+void sample_floors(struct building *b, u64 now){
+	struct queue_stats *qs;
+	struct floor_sample *fs;
+	u64 interval_ms = div64_u64(b->sample_ns, NSEC_PER_MSEC);
+	u64 oldest;
+	u64 first;
+	u64 k;
+	u64 j;
+	u32 queue;
+	u32 age;
+	int f;
+
+	if (now < b->sample_next)
+		return;
+	k = div64_u64(now - b->sample_next, b->sample_ns) + 1;
+	first = b->sample_next;
+
+	for (f = 0; f < NUM_FLOORS; ++f){
+		qs = &b->queue_stats[f];
+		queue = b->floor_count[f];
+		oldest = floor_oldest(b, f);
+		age = queue ? div64_u64(first - min(oldest, first), NSEC_PER_MSEC) : 0;
+
+		if (b->samples == 0 || queue < qs->min_queue)
+			qs->min_queue = queue;
+		if (queue > qs->max_queue)
+			qs->max_queue = queue;
+		qs->sum_queue += queue * k;
+		if (b->samples == 0 || age < qs->min_age_ms)
+			qs->min_age_ms = age;
+		if (queue){
+			qs->max_age_ms = max_t(u64, qs->max_age_ms, age + (k - 1) * interval_ms);
+			qs->sum_age_ms += age * k + interval_ms * (k * (k - 1) / 2);
+		}
+
+		// only the last SAMPLE_RING of them stay in the ring
+		for (j = k > SAMPLE_RING ? k - SAMPLE_RING : 0; j < k; ++j){
+			fs = &b->sample_ring[f][(b->samples + j) % SAMPLE_RING];
+			fs->queue = queue;
+			fs->age_ms = queue ? age + j * interval_ms : 0;
+		}
+	}
+	b->samples += k;
+	b->sample_next = first + k * b->sample_ns;
+}
+
+/*
+			Count request @p and switch the traffic mode if the recent mix calls for it.
+*/
+static void classify_traffic(struct building *b, Passenger *p){
+	int from_pct;
+	int to_pct;
+	int mode;
+
+	b->od_total += OD_ONE - (b->od_total >> OD_DECAY_SHIFT);
+	b->od_from_lobby -= b->od_from_lobby >> OD_DECAY_SHIFT;
+	b->od_to_lobby -= b->od_to_lobby >> OD_DECAY_SHIFT;
+	if (p->start == START_FLOOR)
+		b->od_from_lobby += OD_ONE;
+	if (p->destination == START_FLOOR)
+		b->od_to_lobby += OD_ONE;
+	b->since_switch += 1;
+
+	if (!traffic_detect || b->since_switch < TRAFFIC_MIN_REQUESTS)
+		return;
+	from_pct = (u64)b->od_from_lobby * 100 / b->od_total;
+	to_pct = (u64)b->od_to_lobby * 100 / b->od_total;
+
+	mode = b->traffic_mode;
+	if (mode == TRAFFIC_UP_PEAK && from_pct < TRAFFIC_EXIT_PCT)
+		mode = TRAFFIC_INTERFLOOR;
+	else if (mode == TRAFFIC_DOWN_PEAK && to_pct < TRAFFIC_EXIT_PCT)
+		mode = TRAFFIC_INTERFLOOR;
+	if (mode == TRAFFIC_INTERFLOOR){
+		if (from_pct >= TRAFFIC_ENTER_PCT)
+			mode = TRAFFIC_UP_PEAK;
+		else if (to_pct >= TRAFFIC_ENTER_PCT)
+			mode = TRAFFIC_DOWN_PEAK;
+	}
+	if (mode != b->traffic_mode){
+		b->traffic_mode = mode;
+		b->traffic_switches += 1;
+		b->since_switch = 0;
+	}
+}
+
+/*
+			Share in percent of recent requests from (@to == 0) or to START_FLOOR
+*/
+int lobby_share(struct building *b, int to){
+	if (b->od_total == 0)
+		return 0;
+	return (u64)(to ? b->od_to_lobby : b->od_from_lobby) * 100 / b->od_total;
+}
+
+/*
+			Insert a passenger into the waiting list of its start floor and class.
+			Walks back from the tail to keep the list ordered by deadline,
+			requests mostly arrive in deadline order so this is O(1) in practice.
+*/
+void queue_passenger(struct building *b, Passenger *p){
+	struct list_head *q = &b->floors[p->start - 1][p->prio];
+	struct list_head *pos;
+	u64 now = ktime_get_ns();
+
+	sample_floors(b, now);
+
+	list_for_each_prev(pos, q){
+		if (list_entry(pos, Passenger, list)->deadline <= p->deadline)
+			break;
+	}
+	list_add(&p->list, pos); /* insert after pos, at the head if everyone has a later deadline */
+	hash_add(b->waiting, &p->hnode, p->ticket);
+	note_arrival(b, p->start - 1, p->arrival);
+	classify_traffic(b, p);
+	rates_advance(b, now);
+	b->accepted.pending += 1;
+	b->floor_accepted[p->start - 1].pending += 1;
+	b->floor_count[p->start - 1] += 1;
+	b->floor_weight[p->start - 1] += p->weight;
+	b->floor_units[p->start - 1] += p->units;
+	post_event(b, ELEVATOR_EV_ARRIVAL, p->start, p);
+}
+
+/*
+			Take a waiting passenger off its waiting list and out of the floor aggregates,
+			it stays on p->list so the caller can move it on.
+*/
+void unqueue_passenger(struct building *b, Passenger *p){
+	sample_floors(b, ktime_get_ns());
+	list_del_init(&p->list);
+	hash_del(&p->hnode);
+	b->floor_count[p->start - 1] -= 1;
+	b->floor_weight[p->start - 1] -= p->weight;
+	b->floor_units[p->start - 1] -= p->units;
+}
+
+/*
+			Earliest deadline among the passengers waiting on @floor_no (0 based),
+			NO_DEADLINE if only best effort passengers are waiting.
+*/
+u64 floor_deadline(struct building *b, int floor_no){
+	u64 earliest = NO_DEADLINE;
+	Passenger *p;
+	int c;
+	for (c = 0; c < NUM_CLASSES; ++c){
+		if (list_empty(&b->floors[floor_no][c]))
+			continue;
+		p = list_first_entry(&b->floors[floor_no][c], Passenger, list);
+		if (p->deadline < earliest)
+			earliest = p->deadline;
+	}
+	return earliest;
+}
+
+/*
+			Arrival time of the oldest passenger waiting on @floor_no (0 based),
+			U64_MAX if the floor is empty.
+*/
+u64 floor_oldest(struct building *b, int floor_no){
+	u64 oldest = U64_MAX;
+	Passenger *p;
+	int c;
+	for (c = 0; c < NUM_CLASSES; ++c){
+		if (list_empty(&b->floors[floor_no][c]))
+			continue;
+		p = list_first_entry(&b->floors[floor_no][c], Passenger, list);
+		if (p->arrival < oldest)
+			oldest = p->arrival;
+	}
+	return oldest;
+}
+
+/*
+			Zero the counters of the elevator of building @b, the time in the current status
+			starts over from now. The car, its passengers and the waiting lists are left alone.
+			Called with both mutexes held, the step, a stats read and the reports read
+			these counters under them and must never see half of them zeroed.
+*/
+static void clear_counters(struct building *b){
+	int i;
+
+	lockdep_assert_held(&b->elevator_l_mutex);
+	lockdep_assert_held(&b->floors_l_mutex);
+	b->elevator.serviced = 0;
+	for (i = 0; i < NUM_FLOORS; ++i){
+		b->elevator.served_per_fl[i] = 0;
+	}
+	for (i = 0; i < NUM_CLASSES; ++i){
+		b->elevator.boarded_per_class[i] = 0;
+		b->elevator.deadline_miss[i] = 0;
+	}
+	for (i = 0; i < WAIT_BUCKETS; ++i){
+		b->elevator.wait_hist[i] = 0;
+	}
+	b->elevator.longest_wait = 0;
+	b->elevator.cancelled = 0;
+	b->elevator.stops_avoided = 0;
+	b->elevator.holds = 0;
+	b->elevator.held_boarded = 0;
+	b->elevator.hold_ns = 0;
+	b->elevator.departures = 0;
+	b->elevator.departure_units = 0;
+	b->elevator.departure_weight = 0;
+	for (i = 0; i < NUM_STATUS; ++i){
+		b->elevator.status_ns[i] = 0;
+	}
+	b->elevator.status_since = ktime_get_ns();
+	b->elevator.floors_loaded = 0;
+	b->elevator.floors_empty = 0;
+	b->elevator.stops_boarded = 0;
+	b->elevator.stops_unboarded = 0;
+}
+
+/*
+			Zero every counter and rate of building @b without touching the elevator,
+			it keeps running with its passengers. Whoever holds a mutex while this waits for
+			it keeps its hold in the lock counters. Triggered through /proc/elevator/control
+			or ELEVATOR_IOC_RESET.
+*/
+long elevator_reset_counters(struct building *b){
+	int i;
+
+	if (elevator_lock_interruptible(b, LOCK_SITE_RESET))
+		return -EINTR;
+	floors_lock(b, LOCK_SITE_RESET);
+	clear_counters(b);
+	b->elevator.dropped = 0;
+	b->elevator.last_shutdown_ns = 0;
+	b->traffic_switches = 0;
+	memset(b->step_stats, 0, sizeof(b->step_stats));
+	memset(b->elevator_lock_stats.sites, 0, sizeof(b->elevator_lock_stats.sites));
+	memset(b->floors_lock_stats.sites, 0, sizeof(b->floors_lock_stats.sites));
+	b->rate_tick = ktime_get_ns();
+	clear_samples(b, b->rate_tick);
+	clear_rate(&b->accepted);
+	clear_rate(&b->delivered);
+	for (i = 0; i < NUM_FLOORS; ++i){
+		clear_rate(&b->floor_accepted[i]);
+		clear_rate(&b->floor_delivered[i]);
+	}
+	floors_unlock(b);
+	elevator_unlock(b);
+	return 0;
+}
+
+/*
+			Leave the elevator of a new building @b offline on floor 1 until it is started.
+			The car is set up directly, a start and stop here would depend on the worker
+			running in between, which a parked timer mode building never does.
+			Called by building_create() before @b is published.
+*/
+void elevator_init(struct building *b){
+	elevator_lock(b, LOCK_SITE_START);
+	floors_lock(b, LOCK_SITE_START);
+	b->elevator.status = OFFLINE;
+	b->elevator.phase = PHASE_IDLE;
+	b->elevator.floor = 1;
+	b->elevator.w_load = 0;
+	b->elevator.unit_load = 0;
+	b->elevator.up_bound = -1;
+	b->elevator.low_bound = -1;
+	b->elevator.next_stop = -1;
+	b->elevator.shutdown = 0;
+	b->step_due = 0;
+	clear_counters(b);
+	INIT_LIST_HEAD(&b->elevator.p_list);
+	floors_unlock(b);
+	elevator_unlock(b);
+}
+
+/*
+			Function that initializes the elevator of building @b.
+			Triggered by a system call. Takes both mutexes like every other writer of the car,
+			so a start cannot tear a step, a stats read or a counter reset.
+*/
+long elevator_start(struct building *b){
+	if (elevator_lock_interruptible(b, LOCK_SITE_START))
+		return -EINTR;
+	floors_lock(b, LOCK_SITE_START);
+	if (b->elevator.status == IDLE || b->elevator.status == LOADING || b->elevator.status == UP || b->elevator.status == DOWN){
+		floors_unlock(b);
+		elevator_unlock(b);
+		return 1;
+	}
+	printk(KERN_INFO "elevator %s: starting\n", b->name);
+
+	b->elevator.status = IDLE;
+	b->elevator.w_load = 0;
+	b->elevator.unit_load = 0;
+	b->elevator.floor = 1; 
+	b->elevator.up_bound = -1;
+	b->elevator.low_bound = -1;
+	b->elevator.next_stop = -2;
+	b->elevator.shutdown = -1;
+	clear_counters(b);
+	b->elevator.phase = PHASE_IDLE;
+	// init the list of passengers in the elevator 
+	INIT_LIST_HEAD(&b->elevator.p_list);
+	post_event(b, ELEVATOR_EV_STATE, b->elevator.floor, NULL);
+	floors_unlock(b);
+	elevator_unlock(b);
+	elevator_kick(b);
+	return 0;
+}
+
+/*
+			Allocate the passenger for a request to building @b into @out, with the next ticket of @b.
+			Returns 1 if the request is not valid (one of the variables is out of range,
+			or it starts on its destination floor, where the car would never stop for it),
+			-ENOMEM if it could not be allocated, 0 otherwise.
+*/
+long make_passenger(struct building *b, int passenger_type, int start_floor, int destination_floor, Passenger **out){
+	if ( (passenger_type > 4) || (passenger_type < 1) )
+		return 1;
+	else if ( (start_floor < 1) || (start_floor > 10) )
+		return 1;
+	else if ( (destination_floor < 1) || (destination_floor > 10) )
+		return 1;
+	else if (start_floor == destination_floor)
+		return 1;
+	else {
+		struct elevator_config *cfg;
+		Passenger *p;
+		int weight;
+		int units;
+
+		rcu_read_lock();
+		cfg = rcu_dereference(b->cfg);
+		weight = cfg->weight[passenger_type - 1];
+		units = cfg->units[passenger_type - 1];
+		rcu_read_unlock();
+
+		p = kmalloc(sizeof(Passenger) * 1, __GFP_RECLAIM);
+		if (p == NULL)
+			return -ENOMEM;
+
+		p->weight = weight;
+		p->units = units;
+		p->start = start_floor;
+		p->destination = destination_floor;
+		p->type = passenger_type; 
+		p->prio = clamp(prio_class[passenger_type - 1], CLASS_BEST_EFFORT, CLASS_URGENT);
+		p->arrival = ktime_get_ns();
+		if (max_wait[passenger_type - 1] > 0)
+			p->deadline = p->arrival + (u64)max_wait[passenger_type - 1] * NSEC_PER_SEC;
+		else
+			p->deadline = NO_DEADLINE;
+		p->boarded = 0;
+		p->ticket = atomic64_inc_return(&b->next_ticket);
+		p->producer = 0;
+		p->ring = NULL;
+		p->user_tag = 0;
+		p->tk = NULL;
+		*out = p;
+	}
+
+	return 0;
+}
+
+/*
+			Function that places a passenger on a waiting list of building @b.
+			Triggered by a system call.
+*/
+long elevator_issue(struct building *b, int passenger_type, int start_floor, int destination_floor){
+	Passenger *p;
+	long ret;
+
+	ret = make_passenger(b, passenger_type, start_floor, destination_floor, &p);
+	if (ret)
+		return ret;
+
+	elevator_queue(b, p);
+	return 0;
+}
+
+/*
+			Place passenger @p from make_passenger() on its waiting list,
+			@p may be delivered and freed as soon as this returns.
+*/
+void elevator_queue(struct building *b, Passenger *p){
+	floors_lock(b, LOCK_SITE_QUEUE);
+	queue_passenger(b, p);
+	floors_unlock(b);
+	elevator_kick(b);
+}
+
+/*
+			Place every passenger on @batch on its waiting list,
+			with a single lock hold and a single kick for the whole batch.
+*/
+void elevator_queue_batch(struct building *b, struct list_head *batch){
+	Passenger *p, *next;
+
+	if (list_empty(batch))
+		return;
+	floors_lock(b, LOCK_SITE_QUEUE);
+	list_for_each_entry_safe(p, next, batch, list){
+		queue_passenger(b, p);
+	}
+	floors_unlock(b);
+	elevator_kick(b);
+}
+
+/*
+			Shortest route to drop off everyone aboard. On a line every route that is not
+			one of the two with at most one turn (nearest extreme first) travels farther, and
+			every destination is a stop either way, so the cheaper of the two is optimal.
+			Ties go to the route with the lower total ride time of the passengers.
+			Returns the floors to travel, @dir gets the direction to start in and @stops the
+			number of stops, called with elevator_l_mutex held.
+*/
+static int drain_plan(struct building *b, int *dir, int *stops){
+	Passenger *p;
+	int stop_at[NUM_FLOORS + 1] = {0};
+	int x = b->elevator.floor;
+	int lo = x;
+	int hi = x;
+	int up_ride = 0;
+	int down_ride = 0;
+	int up_first;
+	int i;
+
+	list_for_each_entry(p, &b->elevator.p_list, list){
+		lo = min(lo, p->destination);
+		hi = max(hi, p->destination);
+		stop_at[p->destination] = 1;
+	}
+	*stops = 0;
+	for (i = 1; i <= NUM_FLOORS; ++i)
+		*stops += stop_at[i];
+
+	// floors every passenger rides on either route
+	list_for_each_entry(p, &b->elevator.p_list, list){
+		if (p->destination >= x){
+			up_ride += p->destination - x;
+			down_ride += 2 * (x - lo) + p->destination - x;
+		}
+		else {
+			down_ride += x - p->destination;
+			up_ride += 2 * (hi - x) + x - p->destination;
+		}
+	}
+
+	if (lo == x)
+		up_first = 1;
+	else if (hi == x)
+		up_first = 0;
+	else
+		up_first = hi - x < x - lo || (hi - x == x - lo && up_ride <= down_ride);
+	*dir = up_first ? UP : DOWN;
+	return (hi - lo) + min(hi - x, x - lo);
+}
+
+/*
+			Function that turns off the elevator of building @b.
+			Triggered by a system call
+*/
+long elevator_stop(struct building *b){
+	int dir;
+	int stops;
+
+	if (elevator_lock_interruptible(b, LOCK_SITE_STOP))
+		return -EINTR;
+	
+	if (b->elevator.status == OFFLINE || b->elevator.shutdown == 1){
+		elevator_unlock(b);
+		return 1;
+	}
+	b->elevator.shutdown = 1;
+	b->elevator.shutdown_start = ktime_get_ns();
+	b->elevator.drain_floors = 0;
+	b->elevator.drain_plan_floors = drain_plan(b, &dir, &stops);
+	b->elevator.drain_plan_ms = b->elevator.drain_plan_floors * building_cfg(b)->move_ms + stops * building_cfg(b)->load_ms;
+	elevator_unlock(b);
+	elevator_kick(b);
+	return 0;
+	
+}
+
+/*
+			Move passenger @a from a waiting list into the elevator,
+			account for its load and whether it boarded past its deadline.
+*/
+void board_passenger(struct building *b, Passenger *a){
+	u64 now = ktime_get_ns();
+	u64 wait = now - a->arrival;
+
+	a->boarded = now;
+	if (a->tk != NULL)
+		ticket_update(a->tk, ELEVATOR_TICKET_BOARDED, wait, 0);
+	unqueue_passenger(b, a);
+	list_add_tail(&a->list, &b->elevator.p_list); /* move to back of list */
+	b->elevator.w_load += a->weight;
+	b->elevator.unit_load += a->units;
+	b->elevator.boarded_per_class[a->prio] += 1;
+	if (a->deadline != NO_DEADLINE && now > a->deadline)
+		b->elevator.deadline_miss[a->prio] += 1;
+
+	b->elevator.wait_hist[min_t(u64, wait / NSEC_PER_SEC, WAIT_BUCKETS - 1)] += 1;
+	if (wait > b->elevator.longest_wait)
+		b->elevator.longest_wait = wait;
+	post_event(b, ELEVATOR_EV_BOARD, b->elevator.floor, a);
+}
+
+/*
+			Whether an empty car in a peak mode is on its way to collect the people waiting on
+			next_stop, passing the floors in between. It keeps that course and picks up only
+			those going its way on the way, so in down-peak it fills from the top down instead of
+			turning at the first floor with someone waiting, and in up-peak it does not turn
+			away from the lobby. Not when the people on next_stop fill the car on their own,
+			it has to come back for the floors in between then anyway.
+*/
+static int collecting(struct building *b){
+	struct elevator_config *cfg = building_cfg(b);
+	int next = b->elevator.next_stop;
+
+	if (!traffic_params[b->traffic_mode].direction || !list_empty(&b->elevator.p_list))
+		return 0;
+	if (next <= 0 || next == b->elevator.floor || (next > b->elevator.floor) != (b->elevator.direction == UP))
+		return 0;
+	if (floor_empty(b, next - 1))
+		return 0;
+	return b->floor_units[next - 1] < cfg->max_units && b->floor_weight[next - 1] < cfg->max_weight;
+}
+
+/* 
+			Place people from the waiting list @queue in the elevator,if there is enough room.
+			If elevator was empty, update the direction.
+			Update bounds, next_stop, weight and unit load. 
+*/
+void load_queue(struct building *b, struct list_head *queue, int dir) {
+	struct list_head *temp;
+	struct list_head *dummy;
+	struct elevator_config *cfg = building_cfg(b);
+	Passenger *a;
+
+	/* move items to a temporary list to illustrate movement */
+	//list_for_each_prev_safe(temp, dummy, &animals.list) { /* backwards */
+	list_for_each_safe(temp, dummy, queue) { /* forwards */
+		a = list_entry(temp, Passenger, list);
+		if ( (b->elevator.w_load + a->weight <= cfg->max_weight) && (b->elevator.unit_load + a->units <= cfg->max_units) ) {
+			// elevator changes direction only when empty
+			// first person that enters sets the direction
+			if (list_empty(&b->elevator.p_list)){ 
+				// only someone going @dir may set it
+				if (dir && (a->destination > b->elevator.floor ? UP : DOWN) != dir)
+					continue;
+				if (a -> destination > b->elevator.floor){
+					b->elevator.direction = UP;
+					b->elevator.up_bound = a -> destination;
+					b->elevator.next_stop = a -> destination;
+				}	
+				else{
+					b->elevator.direction = DOWN;
+					b->elevator.low_bound = a -> destination;
+					b->elevator.next_stop = a -> destination;
+				}
+				board_passenger(b, a);
+				// add floor serviced here 
+			}
+			else if (b->elevator.direction == UP && a->destination > b->elevator.floor) {
+				board_passenger(b, a);
+				if (a->destination > b->elevator.up_bound){
+					b->elevator.up_bound = a -> destination;
+				}
+				else if (a -> destination < b->elevator.next_stop){
+					b->elevator.next_stop = a -> destination;
+				}
+			}
+			else if (b->elevator.direction == DOWN && a->destination < b->elevator.floor) {
+				board_passenger(b, a);
+				if (a->destination < b->elevator.low_bound){
+					b->elevator.low_bound = a -> destination;
+				}
+				else if (a -> destination > b->elevator.next_stop){
+					b->elevator.next_stop = a -> destination;
+				}
+			}	
+		}
+	}
+}
+
+/*
+			Place people from a floor floor_no in the b->elevator.
+			Higher priority classes board first, each class in deadline order.
+			In a peak mode an empty car lets the passengers going with the peak in first,
+			and only those going its own way while collecting().
+*/
+void load_elevator(struct building *b, int floor_no) {
+	int dir = 0;
+	int en_route = 0;
+	int c;
+
+	if (list_empty(&b->elevator.p_list) && traffic_params[b->traffic_mode].direction){
+		en_route = collecting(b);
+		dir = en_route ? b->elevator.direction : traffic_params[b->traffic_mode].direction;
+	}
+	for (c = NUM_CLASSES - 1; c >= 0; --c){
+		if (dir)
+			load_queue(b, &b->floors[floor_no][c], dir);
+		if (!en_route)
+			load_queue(b, &b->floors[floor_no][c], 0);
+	}
+}
+
+/* 
+			Unload people from the elevator if floor_no equals their destination 
+*/
+void unload_elevator(struct building *b, int floor_no){
+	struct list_head move_list;
+	struct list_head *temp;
+	struct list_head *dummy;
+	int i;
+	Passenger *a;
+
+	INIT_LIST_HEAD(&move_list);
+
+	/* move items to a temporary list to illustrate movement */
+	//list_for_each_prev_safe(temp, dummy, &animals.list) { /* backwards */
+	list_for_each_safe(temp, dummy, &b->elevator.p_list) { /* forwards */
+		a = list_entry(temp, Passenger, list);
+
+		if (a->destination == floor_no) {
+			list_move_tail(temp, &move_list); /* move to back of list */
+			b->elevator.w_load -= a->weight;
+			b->elevator.unit_load -= a->units;
+			b->elevator.serviced += 1;
+			b->elevator.served_per_fl[(a->start)-1] += 1;
+		}
+	}	
+
+	rates_advance(b, ktime_get_ns());
+
+	/* print stats of list to syslog, entry version just as example (not needed here) */
+	i = 0;
+	list_for_each_entry(a, &move_list, list) { /* forwards */
+		/* can access a directly e.g. a->id */
+		i++;
+	}
+	pr_debug("elevator %s: %d people left on floor %d\n", b->name, i, floor_no);
+
+	/* free up memory allocation of Animals */
+	//list_for_each_prev_safe(temp, dummy, &move_list) { /* backwards */
+	list_for_each_safe(temp, dummy, &move_list) { /* forwards */
+		a = list_entry(temp, Passenger, list);
+		list_del(temp);	/* removes entry from list */
+		b->delivered.pending += 1;
+		b->floor_delivered[floor_no - 1].pending += 1;
+		post_event(b, ELEVATOR_EV_ALIGHT, floor_no, a);
+		release_passenger(a, RELEASE_DELIVERED);
+	}
+}
+
+/*
+			CHeck if any passenger reached his/her destination
+*/
+int should_unload(struct building *b, int f){
+	struct list_head *temp;
+	Passenger *p;
+	// read only access, no need for for_each_safe
+	list_for_each(temp, &b->elevator.p_list){
+		p = list_entry(temp, Passenger, list);
+		
+		if (f == p->destination){
+			return 1; // return true if needs to unload
+		}
+	}
+
+	return 0; // return false if no one is getting out
+}
+
+/*
+			Remove waiting passenger @p, a stop is avoided if nobody else waits on its floor
+			and nobody in the elevator gets out there.
+*/
+static void cancel_passenger(struct building *b, Passenger *p){
+	unqueue_passenger(b, p);
+	b->elevator.cancelled += 1;
+	if (floor_empty(b, p->start - 1) && !should_unload(b, p->start))
+		b->elevator.stops_avoided += 1;
+	post_event(b, ELEVATOR_EV_CANCEL, p->start, p);
+	release_passenger(p, RELEASE_CANCELLED);
+}
+
+/*
+			Cancel waiting requests of building @b, by ticket, floor (1-10),
+			passenger type or producer, depending on @by. Passengers that boarded already
+			ride on. Returns how many were cancelled, @avoided gets the stops this saved.
+*/
+long elevator_cancel(struct building *b, int by, u64 key, int *avoided){
+	Passenger *p, *next;
+	long n = 0;
+	int before;
+	int i, c;
+
+	if (by == ELEVATOR_CANCEL_FLOOR && (key < 1 || key > NUM_FLOORS))
+		return -EINVAL;
+	if (by != ELEVATOR_CANCEL_TICKET && by != ELEVATOR_CANCEL_FLOOR && by != ELEVATOR_CANCEL_TYPE && by != ELEVATOR_CANCEL_PRODUCER)
+		return -EINVAL;
+
+	elevator_lock(b, LOCK_SITE_CANCEL);
+	floors_lock(b, LOCK_SITE_CANCEL);
+	before = b->elevator.stops_avoided;
+	if (by == ELEVATOR_CANCEL_TICKET){
+		hash_for_each_possible(b->waiting, p, hnode, key){
+			if (p->ticket == key){
+				cancel_passenger(b, p);
+				n = 1;
+				break;
+			}
+		}
+	}
+	else {
+		for (i = 0; i < NUM_FLOORS; ++i){
+			if (by == ELEVATOR_CANCEL_FLOOR && i != key - 1)
+				continue;
+			for (c = 0; c < NUM_CLASSES; ++c){
+				list_for_each_entry_safe(p, next, &b->floors[i][c], list){
+					if ((by == ELEVATOR_CANCEL_TYPE && p->type != key) ||
+						(by == ELEVATOR_CANCEL_PRODUCER && p->producer != key))
+						continue;
+					cancel_passenger(b, p);
+					n++;
+				}
+			}
+		}
+	}
+	*avoided = b->elevator.stops_avoided - before;
+	floors_unlock(b);
+	elevator_unlock(b);
+	return n;
+}
+
+/*
+			Whether the passenger waiting on @target with deadline @deadline would board late
+			if the empty car served @first before it, counting the moves by way of @first and a
+			door cycle on each floor.
+*/
+static int deadline_at_risk(struct building *b, int first, int target, u64 deadline, u64 now){
+	struct elevator_config *cfg = building_cfg(b);
+	u64 via;
+
+	via = (u64)(abs(b->elevator.floor - first) + abs(first - target)) * cfg->move_ms + 2 * cfg->load_ms;
+	return now + via * NSEC_PER_MSEC > deadline;
+}
+
+/* 
+			Find the closest non epmty floor or set elevator to idle and return -1 if all floors are empty 
+			Every waiting floor is scored by distance, aged by how long its oldest passenger has
+			waited (see aging_wait_weight) and biased by the traffic mode, so best effort
+			passengers age like everyone else. The floor holding the earliest deadline overrides
+			that choice only when serving the best scored floor first would board it late,
+			ties are broken by distance.
+*/
+int empty_find_next_stop(struct building *b){
+	int closest = 100; // to make sure it get updated on the first check
+	int urgent = 100;
+	u64 earliest = NO_DEADLINE;
+	u64 deadline;
+	u64 now;
+	s64 score;
+	s64 best_score = S64_MAX;
+	int i;
+
+	if (b->elevator.shutdown == 1)
+		return -1;
+	// keep the course, see collecting()
+	if (collecting(b))
+		return b->elevator.next_stop;
+
+	now = ktime_get_ns();
+	for (i = 1; i < 11; ++i){
+		deadline = floor_deadline(b, i-1);
+		if (deadline < earliest || (deadline == earliest && deadline != NO_DEADLINE && abs(b->elevator.floor - i) < abs(b->elevator.floor - urgent))){
+			earliest = deadline;
+			urgent = i;
+		}
+	}
+	for (i = 1; i < 11; ++i){
+		if (floor_empty(b, i-1))
+			continue;
+		score = (s64)aging_dist_weight * abs(b->elevator.floor - i)
+			- (s64)aging_wait_weight * (s64)((now - floor_oldest(b, i-1)) / NSEC_PER_SEC)
+			- traffic_params[b->traffic_mode].height_bonus * (i - START_FLOOR);
+		if (i == START_FLOOR)
+			score -= traffic_params[b->traffic_mode].lobby_bonus;
+		// equal scores go to the closer floor
+		if (score < best_score || (score == best_score && abs(b->elevator.floor - i) < abs(b->elevator.floor - closest))){
+			best_score = score;
+			closest = i;
+		}
+	}
+	if (earliest != NO_DEADLINE && urgent != closest && deadline_at_risk(b, closest, urgent, earliest, now))
+		closest = urgent;
+	// check if there was anyone waiting, if not set to idle
+	if ( closest != 100 ){ 
+		b->elevator.next_stop = closest;
+		if (b->elevator.next_stop > b->elevator.floor){
+			b->elevator.up_bound = closest; // the highest level with a passeneger on it
+			b->elevator.direction = UP;
+			b->elevator.status = UP;
+		}	
+		else{
+			b->elevator.low_bound = closest; // the lowest level with a passeneger on it
+			b->elevator.direction = DOWN;
+			b->elevator.status = DOWN;
+		}
+		return closest;
+	}
+
+	b->elevator.status = IDLE;
+	b->elevator.next_stop = -1;
+	b->elevator.low_bound = -1;
+	b->elevator.up_bound = -1;
+
+	return -1;
+	
+}
+
+/*
+			Whether anyone waiting on the current floor would board. In a peak mode a loaded car
+			or a collecting() one passing a floor stops only for passengers going its way.
+			Otherwise anyone waiting is picked up.
+*/
+static int picks_up(struct building *b){
+	int f = b->elevator.floor;
+	Passenger *p;
+	int c;
+
+	if (!traffic_params[b->traffic_mode].direction || f == b->elevator.next_stop)
+		return 1;
+	if (list_empty(&b->elevator.p_list) && !collecting(b))
+		return 1;
+	for (c = 0; c < NUM_CLASSES; ++c){
+		list_for_each_entry(p, &b->floors[f - 1][c], list){
+			if ((p->destination > f ? UP : DOWN) == b->elevator.direction)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+			Arrived on a new floor, or decided to serve the current one:
+			open the doors if anyone gets out or, unless shutting down, anyone waits who would board.
+			Returns the delay before the next step, or 0 if the doors stay closed.
+*/
+int open_doors(struct building *b){
+	if (should_unload(b, b->elevator.floor) || (!floor_empty(b, b->elevator.floor - 1) && b->elevator.shutdown != 1 && picks_up(b))){
+		b->elevator.status = LOADING;
+		b->elevator.phase = PHASE_DOORS;
+		return building_cfg(b)->load_ms;
+	}
+	return 0;
+}
+
+/*
+			Doors are open, let people out and in.
+			Restore Status after loading, if the elevator is empty look for the next stop.
+*/
+void exchange_passengers(struct building *b){
+	if (should_unload(b, b->elevator.floor)){
+		unload_elevator(b, b->elevator.floor);
+		// the trip ends where the last passenger gets out, whatever next_stop was
+		if (list_empty(&b->elevator.p_list))
+			b->elevator.next_stop = b->elevator.floor;
+	}
+	if (!floor_empty(b, b->elevator.floor - 1) && b->elevator.shutdown != 1)
+		load_elevator(b, b->elevator.floor - 1);
+
+	if (!list_empty(&b->elevator.p_list))
+		b->elevator.status = b->elevator.direction;
+	else if (b->elevator.shutdown != 1)
+		empty_find_next_stop(b);
+}
+
+/*
+			Whether to keep the doors open for another HOLD_SLICE_MS on the current floor.
+			Only with passengers aboard and room for at least one more, nobody left waiting
+			here (they could not board anyway) and at most the budget, dwell_max_ms scaled by
+			the free units. Holding delays everyone aboard and waiting elsewhere, a request on
+			this floor caught by the hold saves a round trip of the car, so the car holds while
+			the expected gap to that request times the people it delays is below a round trip.
+			The expected gap is the measured average gap, or the time since the last request
+			if that is longer already.
+*/
+static int should_hold(struct building *b, u64 now){
+	struct elevator_config *cfg = building_cfg(b);
+	struct list_head *pos;
+	int f = b->elevator.floor - 1;
+	int delayed = 0;
+	u64 budget;
+	u64 round_trip;
+	u64 gap;
+	int i;
+
+	if (dwell_max_ms <= 0 || b->elevator.shutdown == 1)
+		return 0;
+	if (list_empty(&b->elevator.p_list) || !floor_empty(b, f))
+		return 0;
+	if (b->elevator.unit_load >= cfg->max_units || b->elevator.w_load >= cfg->max_weight)
+		return 0;
+	if (b->arrival_gap[f] == 0)
+		return 0;
+
+	budget = (u64)dwell_max_ms * NSEC_PER_MSEC * (cfg->max_units - b->elevator.unit_load) / cfg->max_units;
+	if (now - b->elevator.hold_start >= budget)
+		return 0;
+	list_for_each(pos, &b->elevator.p_list)
+		delayed += 1;
+	for (i = 0; i < NUM_FLOORS; ++i)
+		delayed += b->floor_count[i];
+	round_trip = (u64)2 * (NUM_FLOORS - 1) * cfg->move_ms * NSEC_PER_MSEC;
+	gap = max(b->arrival_gap[f], now - b->last_arrival[f]);
+	return gap * delayed < round_trip;
+}
+
+/*
+			Doors close on a floor, account for the load the car leaves with.
+*/
+static void note_departure(struct building *b){
+	if (list_empty(&b->elevator.p_list))
+		return;
+	b->elevator.departures += 1;
+	b->elevator.departure_units += b->elevator.unit_load;
+	b->elevator.departure_weight += b->elevator.w_load;
+}
+
+/*
+			Load factor of the departures in percent of the current capacity
+*/
+int load_factor(struct building *b){
+	if (b->elevator.departures == 0)
+		return 0;
+	return b->elevator.departure_units * 100 / (b->elevator.departures * building_cfg(b)->max_units);
+}
+
+/*
+			Load factor of the departures in percent of the current weight capacity
+*/
+int weight_factor(struct building *b){
+	if (b->elevator.departures == 0)
+		return 0;
+	return b->elevator.departure_weight * 100 / (b->elevator.departures * building_cfg(b)->max_weight);
+}
+
+/*
+			Charge the time since the last call to the current status,
+			called before every change of status.
+*/
+void account_status(struct building *b, u64 now){
+	b->elevator.status_ns[b->elevator.status] += now - b->elevator.status_since;
+	b->elevator.status_since = now;
+}
+
+/*
+			Time spent in @status up to @now, including the current stretch
+*/
+u64 status_time(struct building *b, int status, u64 now){
+	u64 t = b->elevator.status_ns[status];
+
+	if (status == b->elevator.status)
+		t += now - b->elevator.status_since;
+	return t;
+}
+
+/*
+			Everyone aboard got out, go offline. Whoever still waits is dropped,
+			requests issued while offline wait for the next start.
+*/
+static void finish_shutdown(struct building *b){
+	Passenger *p, *next;
+	int i, c;
+
+	for (i = 0; i < NUM_FLOORS; ++i){
+		for (c = 0; c < NUM_CLASSES; ++c){
+			list_for_each_entry_safe(p, next, &b->floors[i][c], list){
+				unqueue_passenger(b, p);
+				release_passenger(p, RELEASE_DROPPED);
+				b->elevator.dropped += 1;
+			}
+		}
+	}
+	b->elevator.status = OFFLINE;
+	b->elevator.last_shutdown_ns = ktime_get_ns() - b->elevator.shutdown_start;
+	printk(KERN_INFO "elevator %s offline after %llu ms, %d floors drained, planned %d ms and %d floors\n", b->name,
+		b->elevator.last_shutdown_ns / NSEC_PER_MSEC, b->elevator.drain_floors,
+		b->elevator.drain_plan_ms, b->elevator.drain_plan_floors);
+}
+
+/*  
+			Main algorithm, modified SCAN, Works like a "classic" elevator
+			If for instance direction is UP it goes on the highest floor requested,
+			and drops off/picks up passengers, going the same direction, on its way.
+			Changes direction only when empty.
+			Many optimizations possible
+
+			The elevator is a state machine, one call does one transition with both locks held
+			and returns how many ms to wait before the next one, or ELEVATOR_PARKED if there
+			is nothing to do until the next request, start or stop.
+			PHASE_IDLE: pick a direction and start moving, or open the doors on this floor
+			PHASE_MOVING: arrive on the next floor, open the doors if needed
+			PHASE_DOORS: doors are open for load_ms
+			PHASE_LOADING: people get out and in, then PHASE_HOLD or back to PHASE_IDLE
+			PHASE_HOLD: doors held open, late arrivals get in, see should_hold()
+*/
+static int step_phase(struct building *b){
+	int ret;
+	int park;
+	int delay;
+	int waiting;
+	int stops;
+	u64 now;
+
+	switch (b->elevator.phase){
+	case PHASE_IDLE:
+		if (b->elevator.status == OFFLINE)
+			return ELEVATOR_PARKED;
+		if (list_empty(&b->elevator.p_list)){
+			ret = empty_find_next_stop(b);
+			if (b->elevator.shutdown == 1){
+				finish_shutdown(b);
+				return ELEVATOR_PARKED;
+			}
+			park = traffic_params[b->traffic_mode].park_floor;
+			if (ret == -1 && park && b->elevator.floor != park){
+				// wait for the next passengers where the peak starts
+				b->elevator.next_stop = park;
+				b->elevator.direction = park > b->elevator.floor ? UP : DOWN;
+				b->elevator.status = b->elevator.direction;
+				b->elevator.phase = PHASE_MOVING;
+				return building_cfg(b)->move_ms;
+			}
+			if (ret == -1)
+				return ELEVATOR_PARKED;
+			if (ret == b->elevator.floor){
+				b->elevator.status = LOADING;
+				b->elevator.phase = PHASE_DOORS;
+				return building_cfg(b)->load_ms;
+			}
+		}
+		else if (b->elevator.shutdown == 1){
+			// draining, head for the nearer end of the remaining drop offs
+			drain_plan(b, &b->elevator.direction, &stops);
+			b->elevator.status = b->elevator.direction;
+		}
+		if (b->elevator.shutdown == 1)
+			b->elevator.drain_floors += 1;
+		b->elevator.phase = PHASE_MOVING;
+		return building_cfg(b)->move_ms;
+
+	case PHASE_MOVING:
+		if (b->elevator.direction == UP)
+			b->elevator.floor += 1;
+		else
+			b->elevator.floor -= 1;
+		if (list_empty(&b->elevator.p_list))
+			b->elevator.floors_empty += 1;
+		else
+			b->elevator.floors_loaded += 1;
+		delay = open_doors(b);
+		if (delay)
+			return delay;
+		b->elevator.phase = PHASE_IDLE;
+		if (list_empty(&b->elevator.p_list))
+			empty_find_next_stop(b);
+		return 0;
+
+	case PHASE_DOORS:
+		b->elevator.phase = PHASE_LOADING;
+		return 0;
+
+	case PHASE_LOADING:
+		waiting = b->floor_count[b->elevator.floor - 1];
+		exchange_passengers(b);
+		if (b->floor_count[b->elevator.floor - 1] < waiting)
+			b->elevator.stops_boarded += 1;
+		else
+			b->elevator.stops_unboarded += 1;
+		now = ktime_get_ns();
+		b->elevator.hold_start = now;
+		if (should_hold(b, now)){
+			b->elevator.holds += 1;
+			b->elevator.status = LOADING;
+			b->elevator.phase = PHASE_HOLD;
+			b->hold_wait = 1;
+			return HOLD_SLICE_MS;
+		}
+		note_departure(b);
+		b->elevator.phase = PHASE_IDLE;
+		return 0;
+
+	case PHASE_HOLD:
+	default:
+		waiting = b->floor_count[b->elevator.floor - 1];
+		if (waiting > 0){
+			load_elevator(b, b->elevator.floor - 1);
+			b->elevator.held_boarded += waiting - b->floor_count[b->elevator.floor - 1];
+		}
+		now = ktime_get_ns();
+		if (should_hold(b, now)){
+			b->hold_wait = 1;
+			return HOLD_SLICE_MS;
+		}
+		b->elevator.hold_ns += now - b->elevator.hold_start;
+		note_departure(b);
+		b->elevator.status = b->elevator.direction;
+		b->elevator.phase = PHASE_IDLE;
+		return 0;
+	}
+}
+
+/*
+			Do one transition of building @b and account for its cost.
+*/
+int elevator_step(struct building *b){
+	struct step_stats *st;
+	u64 begin;
+	u64 cost;
+	int from;
+	int status;
+	int delay;
+
+	elevator_lock(b, LOCK_SITE_STEP);
+	floors_lock(b, LOCK_SITE_STEP);
+	begin = ktime_get_ns();
+	// a kick that saw hold_wait just before the hold ended came early, only a hold is cut short
+	if (b->elevator.phase != PHASE_HOLD && begin < b->step_due){
+		delay = DIV_ROUND_UP(b->step_due - begin, NSEC_PER_MSEC);
+		floors_unlock(b);
+		elevator_unlock(b);
+		return delay;
+	}
+	from = b->elevator.phase;
+	status = b->elevator.status;
+	// the status held since the last step, a change happens within the step
+	account_status(b, begin);
+	b->hold_wait = 0;
+	delay = step_phase(b);
+	b->step_due = delay == ELEVATOR_PARKED ? 0 : begin + (u64)delay * NSEC_PER_MSEC;
+	cost = ktime_get_ns() - begin;
+
+	if (b->elevator.phase == PHASE_DOORS && from != PHASE_DOORS)
+		post_event(b, ELEVATOR_EV_DOOR_OPEN, b->elevator.floor, NULL);
+	if (b->elevator.status != status)
+		post_event(b, ELEVATOR_EV_STATE, b->elevator.floor, NULL);
+
+	st = &b->step_stats[from];
+	st->count += 1;
+	st->total_ns += cost;
+	if (cost > st->max_ns)
+		st->max_ns = cost;
+	floors_unlock(b);
+	elevator_unlock(b);
+	return delay;
+}
+
+/*
+			Cut a door hold short on a new request or a stop, moves and door cycles
+			always take their full time. hold_wait is read without the locks, a kick that
+			races with the end of the hold runs the next step early and elevator_step()
+			only waits out the rest of it.
+*/
+static void elevator_kick_hold(struct building *b){
+	if (!READ_ONCE(b->hold_wait))
+		return;
+	if (b->timer_mode)
+		mod_delayed_work(elevator_wq, &b->step_work, 0);
+	else
+		wake_up(&b->wait);
+}
+
+/*
+			Wake up a parked elevator, called after a request is queued and on start/stop.
+			kicked is set before parked is read and the worker sets parked before it reads kicked,
+			so at least one side sees the other and no request is left waiting.
+*/
+void elevator_kick(struct building *b){
+	atomic_set(&b->kicked, 1);
+	smp_mb();
+	if (!atomic_read(&b->parked)){
+		elevator_kick_hold(b);
+		return;
+	}
+	if (b->timer_mode){
+		if (atomic_cmpxchg(&b->parked, 1, 0) == 1)
+			queue_delayed_work(elevator_wq, &b->step_work, 0);
+	}
+	else {
+		wake_up(&b->wait);
+	}
+}
+
+/*
+			Thread mode, one kthread per building sleeps through every transition.
+			Every sleep ends early on kthread_stop(), so destroying the building or unloading
+			the module does not wait for a move to finish, and a door hold ends early on a kick.
+*/
+int run_elevator(void* params){
+	struct building *b = params;
+	int delay;
+
+	while (!kthread_should_stop())
+	{
+		atomic_set(&b->kicked, 0);
+		delay = elevator_step(b);
+		if (delay == ELEVATOR_PARKED){
+			atomic_set(&b->parked, 1);
+			smp_mb();
+			wait_event_interruptible(b->wait, atomic_read(&b->kicked) || kthread_should_stop());
+			atomic_set(&b->parked, 0);
+		}
+		else if (delay > 0){
+			wait_event_interruptible_timeout(b->wait,
+				kthread_should_stop() || (READ_ONCE(b->hold_wait) && atomic_read(&b->kicked)),
+				msecs_to_jiffies(delay));
+		}
+	}
+	return 0;	
+}
+
+/*
+			Timer mode, the transitions of every building run from delayed work
+			on the shared elevator workqueue, no thread sleeps on behalf of a building.
+*/
+void elevator_step_work(struct work_struct *work){
+	struct building *b = container_of(to_delayed_work(work), struct building, step_work);
+	int delay;
+
+	atomic_set(&b->kicked, 0);
+	delay = elevator_step(b);
+	while (delay == 0)
+		delay = elevator_step(b);
+
+	if (delay != ELEVATOR_PARKED){
+		queue_delayed_work(elevator_wq, &b->step_work, msecs_to_jiffies(delay));
+		return;
+	}
+	atomic_set(&b->parked, 1);
+	smp_mb();
+	if (atomic_read(&b->kicked) && atomic_cmpxchg(&b->parked, 1, 0) == 1)
+		queue_delayed_work(elevator_wq, &b->step_work, 0);
+}
+
+/*
+			Get the total weight of wait list on @floor_no
+*/
+int floor_w_load(struct building *b, int floor_no){
+	return b->floor_weight[floor_no];
+}
+
+/*
+			Get the total units of wait list on @floor_no
+*/
+int floor_u_load(struct building *b, int floor_no){
+	return b->floor_units[floor_no];
+}
+
+/*
+			Wait time in seconds below which @pct percent of the boarded passengers fall
+*/
+int wait_percentile(struct building *b, int pct){
+	int i;
+	int total = 0;
+	int seen = 0;
+	for (i = 0; i < WAIT_BUCKETS; ++i)
+		total += b->elevator.wait_hist[i];
+	if (total == 0)
+		return 0;
+	for (i = 0; i < WAIT_BUCKETS; ++i){
+		seen += b->elevator.wait_hist[i];
+		if ((s64)seen * 100 >= (s64)total * pct)
+			break;
+	}
+	return i;
+}
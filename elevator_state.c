@@ -0,0 +1,425 @@
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/slab.h>
+#include <linux/mm.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/uaccess.h>
+#include <linux/ktime.h>
+
+#include "elevator.h"
+#include "elevator_uapi.h"
+
+// bound on the passengers of an imported state, far above anything a building holds
+#define STATE_PASSENGERS_MAX (1 << 20)
+
+/*
+			State handoff between module instances, see ELEVATOR_IOC_EXPORT in elevator_uapi.h.
+			Layout: header, car, wait histogram of wait_buckets u32, then the waiting
+			passengers floor by floor and class by class followed by the ones aboard.
+			Step statistics are not carried over, they measure the code of one instance.
+*/
+
+static void export_passenger(struct elevator_state_passenger *rec, Passenger *p){
+	memset(rec, 0, sizeof(*rec));
+	rec->type = p->type;
+	rec->start = p->start;
+	rec->dest = p->destination;
+	rec->prio = p->prio;
+	rec->arrival_ns = p->arrival;
+	rec->deadline_ns = p->deadline;
+	rec->boarded_ns = p->boarded;
+	rec->ticket = p->ticket;
+}
+
+static void export_car(struct elevator_state_car *car, struct building *b){
+	struct elevator *e = &b->elevator;
+	int i;
+
+	memset(car, 0, sizeof(*car));
+	car->status = e->status;
+	car->direction = e->direction;
+	car->floor = e->floor;
+	car->next_stop = e->next_stop;
+	car->up_bound = e->up_bound;
+	car->low_bound = e->low_bound;
+	car->shutdown = e->shutdown;
+	car->w_load = e->w_load;
+	car->unit_load = e->unit_load;
+	car->serviced = e->serviced;
+	for (i = 0; i < NUM_FLOORS; ++i)
+		car->served_per_floor[i] = e->served_per_fl[i];
+	for (i = 0; i < NUM_CLASSES; ++i){
+		car->boarded_per_class[i] = e->boarded_per_class[i];
+		car->deadline_miss[i] = e->deadline_miss[i];
+	}
+	car->longest_wait_ns = e->longest_wait;
+	car->cancelled = e->cancelled;
+	car->stops_avoided = e->stops_avoided;
+	car->holds = e->holds;
+	car->held_boarded = e->held_boarded;
+	car->hold_ns = e->hold_ns;
+	car->departures = e->departures;
+	car->departure_units = e->departure_units;
+	car->dropped = e->dropped;
+	car->traffic_mode = b->traffic_mode;
+	car->traffic_switches = b->traffic_switches;
+	car->od_total = b->od_total;
+	car->od_from_lobby = b->od_from_lobby;
+	car->od_to_lobby = b->od_to_lobby;
+	car->next_ticket = atomic64_read(&b->next_ticket);
+	car->last_shutdown_ns = e->last_shutdown_ns;
+	for (i = 0; i < NUM_STATUS; ++i)
+		car->status_ns[i] = status_time(b, i, ktime_get_ns());
+	car->floors_loaded = e->floors_loaded;
+	car->floors_empty = e->floors_empty;
+	car->stops_boarded = e->stops_boarded;
+	car->stops_unboarded = e->stops_unboarded;
+	car->departure_weight = e->departure_weight;
+}
+
+/*
+			Take everyone out of building @b and turn it off, they live on in the exported state.
+			Tickets and rings of this instance see them dropped.
+*/
+static void detach_building(struct building *b){
+	Passenger *p, *next;
+	int i, c;
+
+	for (i = 0; i < NUM_FLOORS; ++i){
+		for (c = 0; c < NUM_CLASSES; ++c){
+			list_for_each_entry_safe(p, next, &b->floors[i][c], list){
+				unqueue_passenger(b, p);
+				release_passenger(p, RELEASE_DROPPED);
+			}
+		}
+	}
+	list_for_each_entry_safe(p, next, &b->elevator.p_list, list){
+		list_del(&p->list);
+		release_passenger(p, RELEASE_DROPPED);
+	}
+	b->elevator.w_load = 0;
+	b->elevator.unit_load = 0;
+	account_status(b, ktime_get_ns());
+	b->elevator.status = OFFLINE;
+	b->elevator.phase = PHASE_IDLE;
+	post_event(b, ELEVATOR_EV_STATE, b->elevator.floor, NULL);
+}
+
+/*
+			Write the state of building @b to user space at @dst, with both locks held so it is
+			one consistent snapshot. Copying under the locks keeps the step waiting on a page
+			fault at worst, and lets a detach happen only once the copy succeeded.
+*/
+long elevator_export(struct building *b, struct elevator_state_xfer *xfer){
+	struct elevator_state_header hdr;
+	struct elevator_state_car car;
+	struct elevator_state_passenger rec;
+	char __user *dst = u64_to_user_ptr(xfer->buf);
+	Passenger *p;
+	u64 size;
+	int aboard = 0;
+	int waiting = 0;
+	int i, c;
+	long ret = 0;
+
+	BUILD_BUG_ON(sizeof(b->name) > sizeof(hdr.name));
+
+	if (elevator_lock_interruptible(b, LOCK_SITE_STATE))
+		return -EINTR;
+	floors_lock(b, LOCK_SITE_STATE);
+
+	for (i = 0; i < NUM_FLOORS; ++i)
+		waiting += b->floor_count[i];
+	list_for_each_entry(p, &b->elevator.p_list, list)
+		aboard++;
+	size = sizeof(hdr) + sizeof(car) + WAIT_BUCKETS * sizeof(u32) + (u64)(waiting + aboard) * sizeof(rec);
+	if (xfer->size < size){
+		xfer->size = size;
+		ret = -ENOSPC;
+		goto out;
+	}
+	xfer->size = size;
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = ELEVATOR_STATE_MAGIC;
+	hdr.version = ELEVATOR_STATE_VERSION;
+	hdr.header_size = sizeof(hdr);
+	hdr.car_size = sizeof(car);
+	hdr.passenger_size = sizeof(rec);
+	hdr.num_floors = NUM_FLOORS;
+	hdr.num_classes = NUM_CLASSES;
+	hdr.wait_buckets = WAIT_BUCKETS;
+	hdr.waiting = waiting;
+	hdr.aboard = aboard;
+	hdr.exported_ns = ktime_get_ns();
+	memcpy(hdr.name, b->name, sizeof(b->name));
+	export_car(&car, b);
+
+	if (copy_to_user(dst, &hdr, sizeof(hdr)))
+		goto fault;
+	dst += sizeof(hdr);
+	if (copy_to_user(dst, &car, sizeof(car)))
+		goto fault;
+	dst += sizeof(car);
+	if (copy_to_user(dst, b->elevator.wait_hist, WAIT_BUCKETS * sizeof(u32)))
+		goto fault;
+	dst += WAIT_BUCKETS * sizeof(u32);
+	for (i = 0; i < NUM_FLOORS; ++i){
+		for (c = 0; c < NUM_CLASSES; ++c){
+			list_for_each_entry(p, &b->floors[i][c], list){
+				export_passenger(&rec, p);
+				if (copy_to_user(dst, &rec, sizeof(rec)))
+					goto fault;
+				dst += sizeof(rec);
+			}
+		}
+	}
+	list_for_each_entry(p, &b->elevator.p_list, list){
+		export_passenger(&rec, p);
+		if (copy_to_user(dst, &rec, sizeof(rec)))
+			goto fault;
+		dst += sizeof(rec);
+	}
+
+	if (xfer->flags & ELEVATOR_EXPORT_DETACH)
+		detach_building(b);
+	goto out;
+
+fault:
+	ret = -EFAULT;
+out:
+	floors_unlock(b);
+	elevator_unlock(b);
+	return ret;
+}
+
+/*
+			Counters and car position of @car into building @b, the loads are
+			recomputed from the passengers aboard.
+*/
+static void import_car(struct building *b, struct elevator_state_car *car){
+	struct elevator *e = &b->elevator;
+	int i;
+
+	e->status = car->status;
+	e->direction = car->direction == DOWN ? DOWN : UP;
+	e->floor = car->floor;
+	e->next_stop = car->next_stop;
+	e->up_bound = car->up_bound;
+	e->low_bound = car->low_bound;
+	e->shutdown = car->shutdown;
+	e->serviced = car->serviced;
+	for (i = 0; i < NUM_FLOORS; ++i)
+		e->served_per_fl[i] = car->served_per_floor[i];
+	for (i = 0; i < NUM_CLASSES; ++i){
+		e->boarded_per_class[i] = car->boarded_per_class[i];
+		e->deadline_miss[i] = car->deadline_miss[i];
+	}
+	e->longest_wait = car->longest_wait_ns;
+	e->cancelled = car->cancelled;
+	e->stops_avoided = car->stops_avoided;
+	e->holds = car->holds;
+	e->held_boarded = car->held_boarded;
+	e->hold_ns = car->hold_ns;
+	e->departures = car->departures;
+	e->departure_units = car->departure_units;
+	e->dropped = car->dropped;
+	e->last_shutdown_ns = car->last_shutdown_ns;
+	for (i = 0; i < NUM_STATUS; ++i)
+		e->status_ns[i] = car->status_ns[i];
+	e->status_since = ktime_get_ns();
+	e->floors_loaded = car->floors_loaded;
+	e->floors_empty = car->floors_empty;
+	e->stops_boarded = car->stops_boarded;
+	e->stops_unboarded = car->stops_unboarded;
+	e->departure_weight = car->departure_weight;
+	// a drain in progress is timed again from the import
+	e->shutdown_start = ktime_get_ns();
+	e->drain_floors = 0;
+	// whatever the car was doing, it resumes from the top of the state machine
+	if (e->status == LOADING)
+		e->status = e->direction;
+	e->phase = PHASE_IDLE;
+}
+
+/*
+			Passenger for record @rec, NULL with *@err set if it is not valid.
+*/
+static Passenger *import_passenger(struct building *b, struct elevator_state_passenger *rec, int aboard, u64 now, long *err){
+	Passenger *p;
+	long ret;
+
+	ret = make_passenger(b, rec->type, rec->start, rec->dest, &p);
+	if (ret){
+		*err = ret < 0 ? ret : -EINVAL;
+		return NULL;
+	}
+	p->prio = min_t(u32, rec->prio, CLASS_URGENT);
+	if (rec->arrival_ns != 0 && rec->arrival_ns <= now){
+		p->arrival = rec->arrival_ns;
+		p->deadline = rec->deadline_ns;
+	}
+	if (aboard)
+		p->boarded = rec->boarded_ns != 0 && rec->boarded_ns <= now ? rec->boarded_ns : p->arrival;
+	if (rec->ticket != 0)
+		p->ticket = rec->ticket;
+	return p;
+}
+
+static void free_list(struct list_head *list){
+	Passenger *p, *next;
+
+	list_for_each_entry_safe(p, next, list, list){
+		list_del(&p->list);
+		release_passenger(p, RELEASE_DROPPED);
+	}
+}
+
+/*
+			Load a state written by elevator_export() into building @b, which must be offline
+			with nobody waiting. Passengers are built before the locks are taken so the
+			building only stops for the splice.
+*/
+long elevator_import(struct building *b, struct elevator_state_xfer *xfer){
+	struct elevator_state_header hdr;
+	struct elevator_state_car car;
+	struct elevator_state_passenger rec;
+	struct list_head waiting;
+	struct list_head aboard;
+	Passenger *p, *next;
+	u32 *hist = NULL;
+	u8 *buf;
+	u8 *pos;
+	u64 size;
+	u64 now;
+	u64 last_ticket;
+	int weight = 0;
+	int units = 0;
+	int i;
+	long ret = 0;
+
+	if (xfer->size < sizeof(hdr))
+		return -EINVAL;
+	if (copy_from_user(&hdr, u64_to_user_ptr(xfer->buf), sizeof(hdr)))
+		return -EFAULT;
+	if (hdr.magic != ELEVATOR_STATE_MAGIC || hdr.version != ELEVATOR_STATE_VERSION)
+		return -EINVAL;
+	if (hdr.header_size < sizeof(hdr) || hdr.car_size == 0 || hdr.wait_buckets == 0)
+		return -EINVAL;
+	if (hdr.passenger_size < offsetof(struct elevator_state_passenger, arrival_ns))
+		return -EINVAL;
+	if (hdr.num_floors != NUM_FLOORS || hdr.num_classes != NUM_CLASSES)
+		return -EINVAL;
+	if (hdr.waiting > STATE_PASSENGERS_MAX || hdr.aboard > STATE_PASSENGERS_MAX || hdr.wait_buckets > STATE_PASSENGERS_MAX)
+		return -EINVAL;
+	size = (u64)hdr.header_size + hdr.car_size + (u64)hdr.wait_buckets * sizeof(u32)
+		+ (u64)(hdr.waiting + hdr.aboard) * hdr.passenger_size;
+	if (xfer->size != size)
+		return -EINVAL;
+
+	buf = kvmalloc(size, GFP_KERNEL);
+	if (buf == NULL)
+		return -ENOMEM;
+	if (copy_from_user(buf, u64_to_user_ptr(xfer->buf), size)){
+		kvfree(buf);
+		return -EFAULT;
+	}
+
+	// sections written by another version are cut or zero filled to ours
+	pos = buf + hdr.header_size;
+	memset(&car, 0, sizeof(car));
+	memcpy(&car, pos, min_t(u32, hdr.car_size, sizeof(car)));
+	pos += hdr.car_size;
+	hist = (u32 *)pos;
+	pos += hdr.wait_buckets * sizeof(u32);
+
+	INIT_LIST_HEAD(&waiting);
+	INIT_LIST_HEAD(&aboard);
+	now = ktime_get_ns();
+	last_ticket = car.next_ticket;
+	for (i = 0; i < hdr.waiting + hdr.aboard; ++i){
+		memset(&rec, 0, sizeof(rec));
+		memcpy(&rec, pos, min_t(u32, hdr.passenger_size, sizeof(rec)));
+		pos += hdr.passenger_size;
+		p = import_passenger(b, &rec, i >= hdr.waiting, now, &ret);
+		if (p == NULL)
+			goto out_free;
+		if (p->ticket > last_ticket)
+			last_ticket = p->ticket;
+		if (i < hdr.waiting){
+			list_add_tail(&p->list, &waiting);
+		}
+		else {
+			weight += p->weight;
+			units += p->units;
+			list_add_tail(&p->list, &aboard);
+		}
+	}
+	if (car.floor < 1 || car.floor > NUM_FLOORS
+		|| car.status < OFFLINE || car.status > UP || (car.status == OFFLINE && hdr.aboard != 0)){
+		ret = -EINVAL;
+		goto out_free;
+	}
+
+	if (elevator_lock_interruptible(b, LOCK_SITE_STATE)){
+		ret = -EINTR;
+		goto out_free;
+	}
+	floors_lock(b, LOCK_SITE_STATE);
+	for (i = 0; i < NUM_FLOORS; ++i){
+		if (b->floor_count[i] != 0)
+			ret = -EBUSY;
+	}
+	if (b->elevator.status != OFFLINE || !list_empty(&b->elevator.p_list))
+		ret = -EBUSY;
+	else if (weight > building_cfg(b)->max_weight || units > building_cfg(b)->max_units)
+		ret = -EINVAL;
+	if (ret){
+		floors_unlock(b);
+		elevator_unlock(b);
+		goto out_free;
+	}
+
+	import_car(b, &car);
+	for (i = 0; i < WAIT_BUCKETS; ++i)
+		b->elevator.wait_hist[i] = 0;
+	// a longer histogram folds into our last bucket
+	for (i = 0; i < hdr.wait_buckets; ++i)
+		b->elevator.wait_hist[min_t(int, i, WAIT_BUCKETS - 1)] += hist[i];
+	list_for_each_entry_safe(p, next, &waiting, list){
+		list_del(&p->list);
+		queue_passenger(b, p);
+	}
+	list_splice_tail_init(&aboard, &b->elevator.p_list);
+	b->elevator.w_load = weight;
+	b->elevator.unit_load = units;
+	// queue_passenger() counted the imported requests again and timed their arrivals
+	b->od_total = car.od_total;
+	b->od_from_lobby = car.od_from_lobby;
+	b->od_to_lobby = car.od_to_lobby;
+	b->traffic_mode = clamp(car.traffic_mode, TRAFFIC_INTERFLOOR, TRAFFIC_DOWN_PEAK);
+	b->traffic_switches = car.traffic_switches;
+	b->since_switch = 0;
+	for (i = 0; i < NUM_FLOORS; ++i){
+		b->last_arrival[i] = 0;
+		b->arrival_gap[i] = 0;
+	}
+	if (last_ticket > atomic64_read(&b->next_ticket))
+		atomic64_set(&b->next_ticket, last_ticket);
+	post_event(b, ELEVATOR_EV_STATE, b->elevator.floor, NULL);
+	floors_unlock(b);
+	elevator_unlock(b);
+
+	printk(KERN_INFO "elevator %s: imported %u waiting and %u aboard from %.16s\n", b->name, hdr.waiting, hdr.aboard, hdr.name);
+	if (car.status != OFFLINE)
+		elevator_kick(b);
+	kvfree(buf);
+	return 0;
+
+out_free:
+	free_list(&waiting);
+	free_list(&aboard);
+	kvfree(buf);
+	return ret;
+}
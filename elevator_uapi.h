@@ -0,0 +1,398 @@
+#ifndef __ELEVATOR_UAPI_H
+#define __ELEVATOR_UAPI_H
+
+/*
+			Interface shared by the module and user space programs.
+			Every __u64 sits at a multiple of 8 with explicit padding fields, so 32 and
+			64 bit user space see the same layout.
+*/
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+#define ELEVATOR_IOC_MAGIC 'E'
+
+/*
+			Control device, /dev/elevator
+			Available as soon as the module is loaded, no patched system calls needed.
+			Every command names its building by id, 0 is the default building.
+			Return values match the system calls: 0 on success, 1 if the elevator was
+			already started or stopped or the request is not valid, -1 with errno
+			ENODEV for an unknown building.
+*/
+#define ELEVATOR_DEV_NAME "elevator"
+#define ELEVATOR_NUM_FLOORS 10
+#define ELEVATOR_NUM_CLASSES 3
+#define ELEVATOR_NUM_STATUS 5
+#define ELEVATOR_RATE_WINDOWS 3		/* 1, 10 and 60 s */
+#define ELEVATOR_BATCH_MAX 4096
+
+struct elevator_request {
+	__u32 type;		/* ADULT, CHILD, ROOM_SERVICE or BELLHOP */
+	__u32 start;		/* 1-10 */
+	__u32 dest;		/* 1-10 */
+	__s32 res;		/* out: issue result of this request */
+	__u64 ticket;		/* out: ticket of the request if it was queued, 0 otherwise */
+};
+
+// elevator_issue.flags and elevator_batch.flags
+#define ELEVATOR_ISSUE_TRACK 1		/* keep the tickets for ELEVATOR_IOC_TICKET_WAIT */
+
+/*
+			Issue up to ELEVATOR_BATCH_MAX requests with one call, they are queued
+			under one lock hold. Returns the number of requests queued, the result
+			and ticket of every request are written back to it.
+*/
+struct elevator_batch {
+	__u32 building;
+	__u32 count;
+	__u64 requests;		/* user pointer to count struct elevator_request */
+	__u32 flags;
+	__u32 pad;
+};
+
+struct elevator_issue {
+	__u32 building;
+	__u32 flags;
+	struct elevator_request req;
+};
+
+/*
+			Tickets
+			Every queued request gets a ticket, unique within its building.
+			Tickets issued with ELEVATOR_ISSUE_TRACK belong to the file they were issued on,
+			ELEVATOR_IOC_TICKET_WAIT blocks until the ticket reaches until, or timeout_ms
+			passed (-1 for no timeout, 0 to just check), and returns its state and durations.
+			Fails with ENOENT for a ticket the file does not track and ETIMEDOUT on timeout.
+			A ticket is forgotten once it was reported DELIVERED or DROPPED.
+			At most ELEVATOR_TICKETS_MAX tickets are tracked per file, issue fails with
+			EAGAIN beyond that.
+*/
+#define ELEVATOR_TICKETS_MAX 65536
+
+// elevator_ticket_wait.until and state
+#define ELEVATOR_TICKET_WAITING 0
+#define ELEVATOR_TICKET_BOARDED 1
+#define ELEVATOR_TICKET_DELIVERED 2
+#define ELEVATOR_TICKET_DROPPED 3	/* never delivered: still waiting when a stop took the elevator
+					   offline, or waiting or aboard when the building was destroyed
+					   or exported with ELEVATOR_EXPORT_DETACH */
+#define ELEVATOR_TICKET_CANCELLED 4	/* cancelled while waiting, wait_ns is the time it waited */
+
+struct elevator_ticket_wait {
+	__u32 building;
+	__u32 until;		/* ELEVATOR_TICKET_BOARDED or ELEVATOR_TICKET_DELIVERED */
+	__u64 ticket;
+	__s32 timeout_ms;
+	__u32 state;		/* out */
+	__u64 wait_ns;		/* out: from the request until boarding */
+	__u64 ride_ns;		/* out: from boarding until delivery */
+};
+
+/*
+			Cancel waiting requests, by ticket, floor, passenger type or producer.
+			ELEVATOR_CANCEL_PRODUCER cancels what was issued through the calling file.
+			Passengers already in the elevator ride on. Returns the number cancelled,
+			stops_avoided counts those that left nobody to pick up or drop off on their floor.
+*/
+#define ELEVATOR_CANCEL_TICKET 1	/* key is the ticket */
+#define ELEVATOR_CANCEL_FLOOR 2		/* key is the floor, 1-10 */
+#define ELEVATOR_CANCEL_TYPE 3		/* key is the passenger type */
+#define ELEVATOR_CANCEL_PRODUCER 4	/* key is ignored */
+
+struct elevator_cancel {
+	__u32 building;
+	__u32 by;
+	__u64 key;
+	__u32 cancelled;	/* out */
+	__u32 stops_avoided;	/* out */
+};
+
+/*
+			Consistent snapshot of one building, taken under the elevator and floor locks.
+*/
+struct elevator_stats {
+	__u32 building;		/* in */
+	__u32 status;		/* OFFLINE 0, IDLE 1, LOADING 2, DOWN 3, UP 4 */
+	__u32 phase;		/* IDLE 0, MOVING 1, DOORS 2, LOADING 3, HOLD 4 */
+	__s32 floor;
+	__s32 next_stop;
+	__u32 weight_load;
+	__u32 unit_load;
+	__u32 serviced;
+	__u32 served_per_floor[ELEVATOR_NUM_FLOORS];
+	__u32 waiting_weight[ELEVATOR_NUM_FLOORS];
+	__u32 waiting_units[ELEVATOR_NUM_FLOORS];
+	__u32 boarded_per_class[ELEVATOR_NUM_CLASSES];
+	__u32 deadline_miss[ELEVATOR_NUM_CLASSES];
+	__u32 p99_wait_s;
+	__u32 pad0;
+	__u64 longest_wait_ns;
+	__u32 cancelled;
+	__u32 stops_avoided;
+	__u32 holds;
+	__u32 held_boarded;
+	__u64 hold_ns;
+	__u32 departures;
+	__u32 load_factor_pct;	/* units aboard at departure in percent of capacity */
+	__u32 traffic_mode;	/* INTERFLOOR 0, UP_PEAK 1, DOWN_PEAK 2 */
+	__u32 traffic_switches;
+	__u64 last_shutdown_ns;	/* from the stop request until offline */
+	__u32 dropped;		/* waiting requests dropped when going offline */
+	__u32 drain_plan_ms;	/* predicted at the stop request */
+	__u32 drain_plan_floors;
+	__u32 drain_floors;	/* traveled since the stop request */
+	__u64 status_ns[ELEVATOR_NUM_STATUS];	/* time spent in each status, by status */
+	__u32 floors_loaded;	/* floors traveled with passengers aboard */
+	__u32 floors_empty;
+	__u32 stops_boarded;	/* door cycles where someone got in */
+	__u32 stops_unboarded;
+	__u32 weight_factor_pct;	/* weight aboard at departure in percent of capacity */
+	__u32 pad;
+	/* moving averages over each window, in thousandths */
+	__u32 accepted_rate[ELEVATOR_RATE_WINDOWS];	/* requests queued per second */
+	__u32 delivered_rate[ELEVATOR_RATE_WINDOWS];	/* passengers delivered per minute */
+	__u32 floor_accepted_rate[ELEVATOR_NUM_FLOORS][ELEVATOR_RATE_WINDOWS];	/* by start floor */
+	__u32 floor_delivered_rate[ELEVATOR_NUM_FLOORS][ELEVATOR_RATE_WINDOWS];	/* by destination */
+};
+
+/*
+			Queue samples of every floor, ELEVATOR_IOC_SAMPLES.
+			The module samples the queue length and the wait of the oldest passenger of
+			every floor each interval_ms (module parameter sample_ms). The min/avg/max
+			cover every sample since the last reset, series holds the last ELEVATOR_SAMPLES
+			of them oldest first, min(taken, ELEVATOR_SAMPLES) are valid and the last one
+			was taken at last_ns. Averages are in thousandths.
+*/
+#define ELEVATOR_SAMPLES 128
+
+struct elevator_floor_sample {
+	__u32 queue;
+	__u32 age_ms;
+};
+
+struct elevator_samples {
+	__u32 building;		/* in */
+	__u32 interval_ms;
+	__u64 taken;
+	__u64 last_ns;
+	__u32 queue_min[ELEVATOR_NUM_FLOORS];
+	__u32 queue_avg[ELEVATOR_NUM_FLOORS];
+	__u32 queue_max[ELEVATOR_NUM_FLOORS];
+	__u32 age_min_ms[ELEVATOR_NUM_FLOORS];
+	__u32 age_avg_ms[ELEVATOR_NUM_FLOORS];
+	__u32 age_max_ms[ELEVATOR_NUM_FLOORS];
+	struct elevator_floor_sample series[ELEVATOR_NUM_FLOORS][ELEVATOR_SAMPLES];
+};
+
+/*
+			Event channel
+			ELEVATOR_IOC_EVENTS returns a new file descriptor that receives the events
+			of one building. read() returns whole struct elevator_event, blocking unless
+			the descriptor is O_NONBLOCK, and poll()/epoll report POLLIN while events
+			are pending. Every listener has its own buffer of params.entries events,
+			events that do not fit are dropped. The next event delivered carries the
+			number dropped before it in lost, ELEVATOR_EVENTS_LOST reads the total.
+*/
+#define ELEVATOR_EVENTS_DEFAULT 256
+#define ELEVATOR_EVENTS_MAX 65536
+
+// elevator_event.type
+#define ELEVATOR_EV_ARRIVAL 1		/* request queued on floor */
+#define ELEVATOR_EV_DOOR_OPEN 2		/* doors open on floor */
+#define ELEVATOR_EV_BOARD 3		/* passenger got in on floor */
+#define ELEVATOR_EV_ALIGHT 4		/* passenger got out on floor */
+#define ELEVATOR_EV_STATE 5		/* status changed to status */
+#define ELEVATOR_EV_CANCEL 6		/* waiting request cancelled on floor */
+
+struct elevator_event {
+	__u64 time_ns;		/* CLOCK_MONOTONIC */
+	__u32 type;
+	__u32 lost;		/* events dropped just before this one */
+	__s32 floor;		/* floor of the event, or of the elevator for ELEVATOR_EV_STATE */
+	__s32 dest;		/* destination of the passenger, 0 for elevator events */
+	__u32 passenger_type;	/* 0 for elevator events */
+	__u32 status;		/* elevator status after the event */
+	__u64 ticket;		/* ticket of the passenger, 0 for elevator events */
+	__u64 duration_ns;	/* wait for ELEVATOR_EV_BOARD and ELEVATOR_EV_CANCEL, ride for ELEVATOR_EV_ALIGHT */
+};
+
+struct elevator_events_params {
+	__u32 building;
+	__u32 entries;		/* power of 2, at most ELEVATOR_EVENTS_MAX, 0 for ELEVATOR_EVENTS_DEFAULT */
+};
+
+/*
+			State handoff for module upgrades
+			ELEVATOR_IOC_EXPORT writes the state of a building to buf: a header, the car,
+			the wait histogram and then one record per passenger, waiting ones first.
+			If size is too small it fails with ENOSPC and sets size to what is needed.
+			With ELEVATOR_EXPORT_DETACH the passengers are taken out of the building and
+			it goes offline, so nobody is served twice after the import.
+			ELEVATOR_IOC_IMPORT loads such a blob into an offline building nobody waits in,
+			EBUSY otherwise. Sections are sized in the header: an importer reads the fields
+			it knows and zero fills the rest, so versions with added fields stay compatible.
+			Times are CLOCK_MONOTONIC ns, valid across module reloads on the same boot.
+*/
+#define ELEVATOR_STATE_MAGIC 0x53564c45		/* "ELVS" */
+#define ELEVATOR_STATE_VERSION 1
+
+// elevator_state_xfer.flags
+#define ELEVATOR_EXPORT_DETACH 1
+
+struct elevator_state_header {
+	__u32 magic;
+	__u16 version;
+	__u16 header_size;
+	__u32 car_size;
+	__u32 passenger_size;
+	__u32 num_floors;
+	__u32 num_classes;
+	__u32 wait_buckets;
+	__u32 waiting;		/* passenger records on floors */
+	__u32 aboard;		/* passenger records in the car */
+	__u32 pad;
+	__u64 exported_ns;
+	char name[16];
+};
+
+struct elevator_state_car {
+	__s32 status;
+	__s32 direction;
+	__s32 floor;
+	__s32 next_stop;
+	__s32 up_bound;
+	__s32 low_bound;
+	__s32 shutdown;
+	__s32 w_load;
+	__s32 unit_load;
+	__s32 serviced;
+	__s32 served_per_floor[ELEVATOR_NUM_FLOORS];
+	__s32 boarded_per_class[ELEVATOR_NUM_CLASSES];
+	__s32 deadline_miss[ELEVATOR_NUM_CLASSES];
+	__u64 longest_wait_ns;
+	__s32 cancelled;
+	__s32 stops_avoided;
+	__s32 holds;
+	__s32 held_boarded;
+	__u64 hold_ns;
+	__s32 departures;
+	__s32 departure_units;
+	__s32 dropped;
+	__s32 traffic_mode;
+	__s32 traffic_switches;
+	__u32 od_total;
+	__u32 od_from_lobby;
+	__u32 od_to_lobby;
+	__u64 next_ticket;
+	__u64 last_shutdown_ns;
+	__u64 status_ns[ELEVATOR_NUM_STATUS];
+	__s32 floors_loaded;
+	__s32 floors_empty;
+	__s32 stops_boarded;
+	__s32 stops_unboarded;
+	__s32 departure_weight;
+	__s32 pad;
+};
+
+struct elevator_state_passenger {
+	__u32 type;
+	__u32 start;
+	__u32 dest;
+	__u32 prio;
+	__u64 arrival_ns;
+	__u64 deadline_ns;	/* ~0 for best effort */
+	__u64 boarded_ns;	/* 0 while waiting */
+	__u64 ticket;
+};
+
+struct elevator_state_xfer {
+	__u32 building;
+	__u32 flags;
+	__u64 buf;		/* user pointer */
+	__u64 size;		/* in: size of buf, out: size of the state */
+};
+
+#define ELEVATOR_IOC_START _IOW(ELEVATOR_IOC_MAGIC, 0x01, __u32)
+#define ELEVATOR_IOC_STOP _IOW(ELEVATOR_IOC_MAGIC, 0x02, __u32)
+#define ELEVATOR_IOC_ISSUE _IOWR(ELEVATOR_IOC_MAGIC, 0x03, struct elevator_issue)
+#define ELEVATOR_IOC_ISSUE_BATCH _IOW(ELEVATOR_IOC_MAGIC, 0x04, struct elevator_batch)
+#define ELEVATOR_IOC_STATS _IOWR(ELEVATOR_IOC_MAGIC, 0x05, struct elevator_stats)
+#define ELEVATOR_IOC_EVENTS _IOW(ELEVATOR_IOC_MAGIC, 0x06, struct elevator_events_params)
+#define ELEVATOR_IOC_TICKET_WAIT _IOWR(ELEVATOR_IOC_MAGIC, 0x07, struct elevator_ticket_wait)
+#define ELEVATOR_IOC_CANCEL _IOWR(ELEVATOR_IOC_MAGIC, 0x08, struct elevator_cancel)
+#define ELEVATOR_IOC_EXPORT _IOWR(ELEVATOR_IOC_MAGIC, 0x09, struct elevator_state_xfer)
+#define ELEVATOR_IOC_IMPORT _IOW(ELEVATOR_IOC_MAGIC, 0x0a, struct elevator_state_xfer)
+#define ELEVATOR_IOC_RESET _IOW(ELEVATOR_IOC_MAGIC, 0x0b, __u32)
+#define ELEVATOR_IOC_SAMPLES _IOWR(ELEVATOR_IOC_MAGIC, 0x0c, struct elevator_samples)
+#define ELEVATOR_EVENTS_LOST _IOR(ELEVATOR_IOC_MAGIC, 0x10, __u64)
+
+/*
+			Submission ring, /dev/elevator_ring
+
+			ELEVATOR_RING_SETUP binds the file to a building and sizes the rings,
+			then mmap() params.mmap_size bytes at offset 0:
+				struct elevator_ring_header at offset 0
+				params.sq_entries struct elevator_sqe at params.sq_off
+				params.cq_entries struct elevator_cqe at params.cq_off
+			Producers fill sqes[sq_tail & (sq_entries - 1)] and publish them with a
+			release store of sq_tail, then ring the doorbell with ELEVATOR_RING_ENTER.
+			The module consumes everything up to sq_tail in one batch and advances sq_head.
+			Completions are read from cqes[cq_head & (cq_entries - 1)] up to cq_tail,
+			user space advances cq_head. poll() reports POLLIN while completions are
+			pending and POLLOUT while the submission ring has room.
+			A completion that does not fit is dropped and counted in cq_overflow.
+*/
+#define ELEVATOR_RING_NAME "elevator_ring"
+#define ELEVATOR_RING_MAX_ENTRIES 4096
+
+struct elevator_sqe {
+	__u32 type;		/* ADULT, CHILD, ROOM_SERVICE or BELLHOP */
+	__u32 start;		/* 1-10 */
+	__u32 dest;		/* 1-10 */
+	__u32 flags;		/* must be 0 */
+	__u64 user_tag;		/* returned in every completion of this request */
+};
+
+// elevator_cqe.event
+#define ELEVATOR_CQE_ACCEPTED 1		/* queued on its start floor */
+#define ELEVATOR_CQE_REJECTED 2		/* not queued, res is 1 for an invalid request or -errno */
+#define ELEVATOR_CQE_DELIVERED 3	/* got out on its destination floor */
+#define ELEVATOR_CQE_CANCELLED 4	/* cancelled while waiting */
+#define ELEVATOR_CQE_DROPPED 5		/* never delivered, as for ELEVATOR_TICKET_DROPPED */
+
+struct elevator_cqe {
+	__u64 user_tag;
+	__u32 event;
+	__s32 res;
+};
+
+/*
+			Each index lives in its own cache line, so producer and consumer
+			do not share lines on the hot path.
+*/
+struct elevator_ring_header {
+	__u32 sq_head;		/* written by the module */
+	__u32 pad0[15];
+	__u32 sq_tail;		/* written by user space */
+	__u32 pad1[15];
+	__u32 cq_head;		/* written by user space */
+	__u32 pad2[15];
+	__u32 cq_tail;		/* written by the module */
+	__u32 cq_overflow;	/* written by the module */
+	__u32 pad3[14];
+};
+
+struct elevator_ring_params {
+	__u32 building;		/* in: building id */
+	__u32 sq_entries;	/* in: power of 2, at most ELEVATOR_RING_MAX_ENTRIES */
+	__u32 cq_entries;	/* in: power of 2, 0 for twice sq_entries */
+	__u32 sq_off;		/* out */
+	__u32 cq_off;		/* out */
+	__u32 mmap_size;	/* out */
+};
+
+#define ELEVATOR_RING_SETUP _IOWR(ELEVATOR_IOC_MAGIC, 0x20, struct elevator_ring_params)
+#define ELEVATOR_RING_ENTER _IO(ELEVATOR_IOC_MAGIC, 0x21)
+
+#endif
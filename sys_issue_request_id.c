@@ -0,0 +1,14 @@
+#include <linux/linkage.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+long (*STUB_issue_request_id)(int, int, int, int) = NULL;
+EXPORT_SYMBOL(STUB_issue_request_id);
+
+
+asmlinkage long sys_issue_request_id(int building, int passenger_type, int start_floor, int destination_floor) {
+	if (STUB_issue_request_id != NULL)
+		return STUB_issue_request_id(building, passenger_type, start_floor, destination_floor);
+	else
+		return -ENOSYS;
+}
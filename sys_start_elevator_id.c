@@ -0,0 +1,15 @@
+#include <linux/linkage.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+/* System call stub */
+long (*STUB_start_elevator_id)(int) = NULL;
+EXPORT_SYMBOL(STUB_start_elevator_id);
+
+/* System call wrapper */
+asmlinkage long sys_start_elevator_id(int building) {
+	if (STUB_start_elevator_id != NULL)
+		return STUB_start_elevator_id(building);
+	else
+		return -ENOSYS;
+}
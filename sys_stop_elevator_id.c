@@ -0,0 +1,14 @@
+#include <linux/linkage.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+
+long (*STUB_stop_elevator_id)(int) = NULL;
+EXPORT_SYMBOL(STUB_stop_elevator_id);
+
+
+asmlinkage long sys_stop_elevator_id(int building) {
+	if (STUB_stop_elevator_id != NULL)
+		return STUB_stop_elevator_id(building);
+	else
+		return -ENOSYS;
+}